@@ -15,22 +15,51 @@
  */
 
 #include <algorithm>
+#include <array>
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <iomanip>
+#include <future>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <optional>
+#include <set>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <thread>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 
-std::vector<std::string> ReadWords() {
-  std::ifstream fin("wordle-answers-alphabetical.txt");
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Reads the list of words from the given file, one word per line.
+std::vector<std::string> ReadWords(const std::string& filename) {
+  std::ifstream fin(filename);
   std::vector<std::string> words;
   while (true) {
     std::string word;
@@ -42,56 +71,463 @@ std::vector<std::string> ReadWords() {
   return words;
 }
 
-// Computes a 3D vector of size N * 3^5 * N where N is the number of words.
+// Reads the weight of every answer from the given file, with one line of the
+// form "<word> <weight>" for every answer, e.g. its frequency. The weights are
+// scaled so they average 1.
+//
+// Returns false if the file can't be read, or any answer is missing or doesn't
+// have a positive weight.
+bool ReadWeights(const std::string& filename,
+                 const std::vector<std::string>& words,
+                 std::vector<float>& weights, std::string& error) {
+  std::ifstream fin(filename);
+  if (!fin) {
+    error = "Failed to read the weights: " + filename;
+    return false;
+  }
+  std::map<std::string, double> weight_of;
+  std::string word;
+  double weight;
+  while (fin >> word >> weight) {
+    weight_of[word] = weight;
+  }
+  double total = 0;
+  for (const std::string& word : words) {
+    auto it = weight_of.find(word);
+    if (it == weight_of.end() || !(it->second > 0)) {
+      error = "Missing or invalid weight for: " + word;
+      return false;
+    }
+    total += it->second;
+  }
+  weights.clear();
+  for (const std::string& word : words) {
+    weights.push_back(weight_of[word] * words.size() / total);
+  }
+  return true;
+}
+
+// Number of letters of every word, which is fixed at compile time, so every
+// word length gets its own specialized build. Compile with e.g.
+// -DWORDLE_WORD_LENGTH=6 for 6 letter words.
+#ifndef WORDLE_WORD_LENGTH
+#define WORDLE_WORD_LENGTH 5
+#endif
+static constexpr int kWordLength = WORDLE_WORD_LENGTH;
+static_assert(kWordLength >= 1 && kWordLength <= 10,
+              "Patterns of words of up to 10 letters fit in 16 bits");
+
+// Returns 3^n.
+constexpr int PowerOfThree(int n) {
+  return n == 0 ? 1 : 3 * PowerOfThree(n - 1);
+}
+
+// Number of possible response patterns for a word, 3^kWordLength, which is
+// 243 for 5 letters.
+static constexpr int kNumPatterns = PowerOfThree(kWordLength);
+
+// A response pattern, in the smallest type that fits all of them: a byte for
+// words of up to 5 letters, and 2 bytes for up to 10 letters.
+using Pattern = std::conditional_t<kNumPatterns <= 256, uint8_t, uint16_t>;
+
+// Dense table with the response pattern for every (guess, answer) pair. All
+// G * A entries are stored in a single contiguous allocation, which keeps the
+// whole table small enough to stay in cache during the recursion.
 //
-// Entry all_word_pattern_matches[i][pattern][j] indicates that if word i is
-// played next and the response is the given pattern, whether the word j is
-// still a possible answer.
+// Guesses are numbered so the first A guesses are the answers, in the same
+// order, followed by the guesses that can never be the answer. That way a word
+// has the same index as a guess and as an answer.
 //
-// Patterns are encoded an int in range [0, 3^5), for all possible patterns.
-std::vector<std::vector<std::vector<bool>>> ComputeWordPatternMatches(
-    const std::vector<std::string>& words) {
-  static constexpr int kNumPatterns = 243;
+// Entry patterns[i * A + j] is the pattern you would see if guess i is played
+// next and answer j is the answer.
+//
+// Patterns are encoded as an int in range [0, 3^kWordLength), for all possible
+// patterns.
+struct PatternTable {
+  int num_guesses = 0;
+  int num_answers = 0;
+  // Points to the G * A patterns, which are kept alive by storage. The storage
+  // is either a vector or a read-only memory mapped file.
+  const Pattern* patterns = nullptr;
+  std::shared_ptr<const void> storage;
+
+  // Returns the patterns of the given guess against every answer.
+  const Pattern* Row(int guess) const {
+    return &patterns[static_cast<size_t>(guess) * num_answers];
+  }
+
+  // Returns the number of patterns.
+  size_t size() const {
+    return static_cast<size_t>(num_guesses) * num_answers;
+  }
+};
+
+// Maximum number of answers that ComputePatternRow scores at once.
+static constexpr int kMaxPatternLanes = 64;
+
+// The letters of all answers in structure-of-arrays layout, so the letters at a
+// given position of consecutive answers are next to each other. Entry
+// letters[c][j] is letter c of answer j. The arrays are padded with zeros to a
+// multiple of kMaxPatternLanes.
+struct AnswerLetters {
+  explicit AnswerLetters(const std::vector<std::string>& words) {
+    int size = (words.size() + kMaxPatternLanes - 1) / kMaxPatternLanes *
+               kMaxPatternLanes;
+    for (int c = 0; c < kWordLength; ++c) {
+      letters[c].resize(size, 0);
+      for (int j = 0; j < words.size(); ++j) {
+        letters[c][j] = words[j][c];
+      }
+    }
+  }
+
+  std::vector<uint8_t> letters[kWordLength];
+};
+
+#if WORDLE_WORD_LENGTH <= 5
 
-  int shift[5];
+// Computes the patterns of the given guess against all answers, kLanes answers
+// at a time, with one byte per answer in a SIMD vector.
+//
+// A letter of the guess that is not green is yellow if, at the positions that
+// are not green, the answer has more of that letter than the positions before
+// it in the guess that have the same letter and are not green either. This is
+// the same as marking letters yellow from left to right while there are any of
+// them left in the answer, so duplicate letters are handled exactly.
+template <int kLanes>
+__attribute__((always_inline)) inline void ComputePatternRowLanes(
+    const std::string& guess, const AnswerLetters& answers, int num_answers,
+    uint8_t* row) {
+  typedef uint8_t Lanes __attribute__((vector_size(kLanes)));
+  // Counts are compared as signed bytes, since x86 only has signed byte
+  // comparisons. They are at most kWordLength.
+  typedef int8_t SignedLanes __attribute__((vector_size(kLanes)));
+
+  int shift[kWordLength];
   shift[0] = 1;
-  for (int c = 1; c < 5; ++c) {
+  for (int c = 1; c < kWordLength; ++c) {
     shift[c] = shift[c - 1] * 3;
   }
 
-  std::vector<std::vector<std::vector<bool>>> all_word_pattern_matches(
-      words.size(), std::vector<std::vector<bool>>(
-                        kNumPatterns, std::vector<bool>(words.size(), false)));
-  std::vector<int> letters_left(26, 0);
-  for (int i = 0; i < words.size(); ++i) {
-    for (int j = 0; j < words.size(); ++j) {
-      const std::string& guess = words[i];
-      const std::string& answer = words[j];
-
-      int pattern = 0;
-      for (int c = 0; c < 5; ++c) {
-        if (guess[c] == answer[c]) {
-          pattern += shift[c] * 2;
-        } else {
-          letters_left[answer[c] - 'a'] += 1;
-        }
+  for (int start = 0; start < num_answers; start += kLanes) {
+    Lanes letters[kWordLength];
+    // Comparisons give all ones in the lanes where they are true, so
+    // subtracting a comparison adds 1 in those lanes.
+    Lanes not_green[kWordLength];
+    Lanes pattern = {};
+    for (int c = 0; c < kWordLength; ++c) {
+      std::memcpy(&letters[c], &answers.letters[c][start], sizeof(letters[c]));
+      Lanes green = letters[c] == static_cast<uint8_t>(guess[c]);
+      not_green[c] = ~green;
+      pattern += green & static_cast<uint8_t>(shift[c] * 2);
+    }
+    for (int c = 0; c < kWordLength; ++c) {
+      uint8_t letter = guess[c];
+      // Number of letters guess[c] in the answer at positions that are not
+      // green.
+      Lanes available = {};
+      for (int k = 0; k < kWordLength; ++k) {
+        available -= (letters[k] == letter) & not_green[k];
       }
-      for (int c = 0; c < 5; ++c) {
-        if (guess[c] != answer[c]) {
-          if (letters_left[guess[c] - 'a'] > 0) {
-            pattern += shift[c] * 1;
-            letters_left[guess[c] - 'a'] -= 1;
-          }
+      // Number of earlier positions in the guess with the same letter that are
+      // not green.
+      Lanes used = {};
+      for (int k = 0; k < c; ++k) {
+        if (guess[k] == guess[c]) {
+          used -= not_green[k];
         }
       }
-      for (int c = 0; c < 5; ++c) {
-        letters_left[answer[c] - 'a'] = 0;
+      Lanes yellow = reinterpret_cast<Lanes>(
+          reinterpret_cast<SignedLanes>(available) >
+          reinterpret_cast<SignedLanes>(used));
+      pattern += yellow & not_green[c] &
+                 static_cast<uint8_t>(shift[c]);
+    }
+    std::memcpy(&row[start], &pattern, std::min(kLanes, num_answers - start));
+  }
+}
+
+// Versions of ComputePatternRowLanes for the instruction sets that can be
+// chosen at runtime. 16 lanes fit the SSE2 registers every x86-64 CPU has. On
+// CPUs with AVX-512, 64 lanes are about twice as fast. 32 lanes with AVX2 were
+// measured to be slower than 16 lanes with SSE2, so there is no AVX2 version.
+void ComputePatternRowDefault(const std::string& guess,
+                              const AnswerLetters& answers, int num_answers,
+                              uint8_t* row) {
+  ComputePatternRowLanes<16>(guess, answers, num_answers, row);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx512bw"))) void ComputePatternRowAvx512(
+    const std::string& guess, const AnswerLetters& answers, int num_answers,
+    uint8_t* row) {
+  ComputePatternRowLanes<64>(guess, answers, num_answers, row);
+}
+#endif
+
+// Computes the patterns of the given guess against all answers, using the
+// widest SIMD instructions the CPU supports.
+void ComputePatternRow(const std::string& guess, const AnswerLetters& answers,
+                       int num_answers, Pattern* row) {
+#if defined(__x86_64__)
+  static const auto compute = []() {
+    if (__builtin_cpu_supports("avx512bw")) {
+      return &ComputePatternRowAvx512;
+    }
+    return &ComputePatternRowDefault;
+  }();
+  compute(guess, answers, num_answers, row);
+#else
+  ComputePatternRowDefault(guess, answers, num_answers, row);
+#endif
+}
+
+#else
+
+// Computes the patterns of the given guess against all answers, one answer at
+// a time, for words whose patterns don't fit in the byte lanes of the SIMD
+// version. Yellow letters are marked from left to right while there are any of
+// them left in the answer, same as in the SIMD version.
+void ComputePatternRow(const std::string& guess, const AnswerLetters& answers,
+                       int num_answers, Pattern* row) {
+  // Number of every letter in the answer at positions that are not green.
+  int available[256] = {};
+  for (int j = 0; j < num_answers; ++j) {
+    bool green[kWordLength];
+    for (int c = 0; c < kWordLength; ++c) {
+      uint8_t letter = answers.letters[c][j];
+      green[c] = letter == static_cast<uint8_t>(guess[c]);
+      if (!green[c]) {
+        ++available[letter];
+      }
+    }
+    int pattern = 0;
+    int shift = 1;
+    for (int c = 0; c < kWordLength; ++c) {
+      uint8_t letter = guess[c];
+      if (green[c]) {
+        pattern += shift * 2;
+      } else if (available[letter] > 0) {
+        --available[letter];
+        pattern += shift;
       }
+      shift *= 3;
+    }
+    row[j] = pattern;
+    for (int c = 0; c < kWordLength; ++c) {
+      available[answers.letters[c][j]] = 0;
+    }
+  }
+}
+
+#endif
+
+// Computes the pattern table for the given lists of guesses and answers, using
+// the given number of threads. The answers must come first in the guesses.
+PatternTable ComputeWordPatternMatches(const std::vector<std::string>& guesses,
+                                       const std::vector<std::string>& answers,
+                                       int num_threads = 1) {
+  PatternTable table;
+  table.num_guesses = guesses.size();
+  table.num_answers = answers.size();
+  auto storage = std::make_shared<std::vector<Pattern>>(table.size());
+  std::vector<Pattern>& patterns = *storage;
+  AnswerLetters answer_letters(answers);
+
+  // Every thread takes the next guess that isn't computed yet.
+  std::atomic<int> next_guess(0);
+  auto compute = [&]() {
+    for (int i = next_guess++; i < guesses.size(); i = next_guess++) {
+      ComputePatternRow(guesses[i], answer_letters, answers.size(),
+                        &patterns[static_cast<size_t>(i) * answers.size()]);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int thread = 1; thread < num_threads; ++thread) {
+    threads.emplace_back(compute);
+  }
+  compute();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  table.patterns = patterns.data();
+  table.storage = storage;
+  return table;
+}
+
+// Precomputed data, like the pattern table, can be saved to a file so it
+// doesn't need to be recomputed every run. Every such file starts with this
+// header. The header has the size of a cache line, so the data after it stays
+// aligned.
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  // Number of guesses, which include the answers.
+  uint32_t num_words;
+  // Hash of the list of guesses the data was computed for.
+  uint64_t words_hash;
+  uint32_t num_answers;
+  char padding[36];
+};
+static_assert(sizeof(FileHeader) == 64);
+
+// Returns the 64 bit FNV-1a hash of the given list of words.
+uint64_t HashWords(const std::vector<std::string>& words) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (const std::string& word : words) {
+    for (char c : word) {
+      hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3;
+    }
+    hash = (hash ^ '\n') * 0x100000001b3;
+  }
+  return hash;
+}
 
-      all_word_pattern_matches[i][pattern][j] = true;
+// Returns the FNV-1a hash of the given weights.
+uint64_t HashWeights(const std::vector<float>& weights) {
+  uint64_t hash = 0xcbf29ce484222325;
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(weights.data());
+  for (size_t i = 0; i < weights.size() * sizeof(float); ++i) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3;
+  }
+  return hash;
+}
+
+// A file memory mapped read-only. That way loading is almost instant, and all
+// processes that load the same file share one copy of it in the page cache.
+struct MappedFile {
+  // The data after the header, which is kept alive by storage.
+  const uint8_t* data;
+  size_t size;
+  std::shared_ptr<const void> storage;
+};
+
+// Maps the given file, checking that its header has the given magic and
+// version and that it was computed for the given guesses and answers. The
+// answers must come first in the guesses.
+//
+// Returns std::nullopt if the file doesn't exist or doesn't match.
+std::optional<MappedFile> MapFile(const std::string& filename,
+                                  const char* magic, uint32_t version,
+                                  const std::vector<std::string>& guesses,
+                                  const std::vector<std::string>& answers) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < sizeof(FileHeader)) {
+    close(fd);
+    return std::nullopt;
+  }
+  size_t size = st.st_size;
+  void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return std::nullopt;
+  }
+  std::shared_ptr<const void> storage(data, [size](const void* data) {
+    munmap(const_cast<void*>(data), size);
+  });
+
+  const FileHeader& header = *static_cast<const FileHeader*>(data);
+  if (std::memcmp(header.magic, magic, sizeof(header.magic)) != 0 ||
+      header.version != version || header.num_words != guesses.size() ||
+      header.num_answers != answers.size() ||
+      header.words_hash != HashWords(guesses)) {
+    return std::nullopt;
+  }
+  MappedFile file;
+  file.data = static_cast<const uint8_t*>(data) + sizeof(header);
+  file.size = size - sizeof(header);
+  file.storage = storage;
+  return file;
+}
+
+// Returns a name to write the given file under before renaming it, which no
+// other process or thread saving the same file uses at the same time.
+std::string TempFilename(const std::string& filename) {
+  static std::atomic<int> num_temp_files{0};
+  return filename + ".tmp." + std::to_string(getpid()) + "." +
+         std::to_string(num_temp_files.fetch_add(1));
+}
+
+// Saves the given data for the given guesses and answers to the given file,
+// after a header with the given magic and version. The file is written under a
+// temporary name first and then renamed, so other processes never load a
+// partially written file.
+void SaveFile(const std::string& filename, const char* magic, uint32_t version,
+              const std::vector<std::string>& guesses,
+              const std::vector<std::string>& answers, const void* data,
+              size_t size) {
+  FileHeader header = {};
+  std::memcpy(header.magic, magic, sizeof(header.magic));
+  header.version = version;
+  header.num_words = guesses.size();
+  header.words_hash = HashWords(guesses);
+  header.num_answers = answers.size();
+
+  std::string temp_filename = TempFilename(filename);
+  std::ofstream fout(temp_filename, std::ios::binary);
+  fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  fout.write(static_cast<const char*>(data), size);
+  fout.close();
+  if (!fout || std::rename(temp_filename.c_str(), filename.c_str()) != 0) {
+    std::remove(temp_filename.c_str());
+    std::cerr << "Failed to save: " << filename << std::endl;
+  }
+}
+
+// The pattern table file holds the G * A patterns after the header.
+static constexpr char kPatternTableMagic[8] = "WRDLPAT";
+// Must be incremented whenever the file format or the encoding of the patterns
+// changes.
+static constexpr uint32_t kPatternTableVersion = 2;
+
+// Loads the pattern table for the given guesses and answers from the given
+// file.
+//
+// Returns std::nullopt if the file doesn't exist or doesn't match the words.
+std::optional<PatternTable> LoadPatternTable(
+    const std::string& filename, const std::vector<std::string>& guesses,
+    const std::vector<std::string>& answers) {
+  std::optional<MappedFile> file = MapFile(
+      filename, kPatternTableMagic, kPatternTableVersion, guesses, answers);
+  PatternTable table;
+  table.num_guesses = guesses.size();
+  table.num_answers = answers.size();
+  if (!file || file->size != table.size() * sizeof(Pattern)) {
+    return std::nullopt;
+  }
+  table.patterns = reinterpret_cast<const Pattern*>(file->data);
+  table.storage = file->storage;
+  return table;
+}
+
+// Saves the given pattern table for the given guesses and answers to the given
+// file.
+void SavePatternTable(const std::string& filename,
+                      const std::vector<std::string>& guesses,
+                      const std::vector<std::string>& answers,
+                      const PatternTable& table) {
+  SaveFile(filename, kPatternTableMagic, kPatternTableVersion, guesses,
+           answers, table.patterns, table.size() * sizeof(Pattern));
+}
+
+// Returns the words in words_left that are still possible if guess is played
+// and the response is the given pattern.
+std::vector<int> FilterWords(const PatternTable& table,
+                             const std::vector<int>& words_left, int guess,
+                             int pattern) {
+  const Pattern* row = table.Row(guess);
+  std::vector<int> new_words_left;
+  for (int word : words_left) {
+    if (row[word] == pattern) {
+      new_words_left.push_back(word);
     }
   }
-  return all_word_pattern_matches;
+  return new_words_left;
 }
 
 // Converts the given pattern in string format to an int.
@@ -100,7 +536,7 @@ std::vector<std::vector<std::vector<bool>>> ComputeWordPatternMatches(
 //   y = correct letter wrong position
 //   g = correct letter correct position.
 int ToPatternInt(const std::string& pattern) {
-  assert(pattern.size() == 5);
+  assert(pattern.size() == kWordLength);
   int result = 0;
   int shift = 1;
   for (int i = 0; i < pattern.size(); ++i) {
@@ -116,239 +552,4805 @@ int ToPatternInt(const std::string& pattern) {
   return result;
 }
 
-// Trims the word patterns vector to remove patterns that have no matches. This
-// is done for efficiency reasons so we avoid looking at these patterns during
-// the recursion.
-std::vector<std::vector<std::vector<bool>>> TrimWordPatternMatches(
-    const std::vector<std::vector<std::vector<bool>>>&
-        all_word_pattern_matches) {
-  std::vector<std::vector<std::vector<bool>>> word_pattern_matches(
-      all_word_pattern_matches.size());
-  for (int i = 0; i < all_word_pattern_matches.size(); ++i) {
-    for (const std::vector<bool>& pattern : all_word_pattern_matches[i]) {
-      int num_matches = 0;
-      for (bool val : pattern) {
-        if (val) {
-          ++num_matches;
-        }
-      }
-      if (num_matches > 0) {
-        word_pattern_matches[i].push_back(pattern);
-      }
+// Returns whether the given pattern in string format is valid.
+bool IsValidPattern(const std::string& pattern) {
+  return pattern.size() == kWordLength &&
+         pattern.find_first_not_of("_yg") == std::string::npos;
+}
+
+// Applies the given guesses already made, which alternate between a guess and
+// its pattern in string format, by prunning words_left. Guesses are looked up
+// in guess_words, the list of all guesses.
+//
+// Returns false and sets error if the guesses are not valid.
+bool ApplyGuesses(const std::vector<std::string>& guess_words,
+                  const PatternTable& table,
+                  const std::vector<std::string>& guesses,
+                  std::vector<int>& words_left, std::string& error) {
+  if (guesses.size() % 2 != 0) {
+    error = "Every guess needs a pattern";
+    return false;
+  }
+  for (int guess_i = 0; guess_i < guesses.size() / 2; ++guess_i) {
+    const std::string& guess = guesses[guess_i * 2];
+    const std::string& pattern = guesses[guess_i * 2 + 1];
+
+    int word_i = std::find(guess_words.begin(), guess_words.end(), guess) -
+                 guess_words.begin();
+    if (word_i == guess_words.size()) {
+      error = "Unknown word: " + guess;
+      return false;
+    }
+    if (!IsValidPattern(pattern)) {
+      error = "Invalid pattern: " + pattern;
+      return false;
+    }
+    words_left = FilterWords(table, words_left, word_i, ToPatternInt(pattern));
+    if (words_left.empty()) {
+      error = "No words are possible";
+      return false;
     }
   }
-  return word_pattern_matches;
+  return true;
 }
 
-// Computes the expected number of guesses you need to make to win, once
-// num_guesses guesses have already been made.
-std::optional<float> Recurse(
-    int num_guesses, int max_num_guesses,
-    std::vector<std::vector<int>>& all_words_left, int num_words_left,
-    const std::vector<std::vector<std::vector<bool>>>& word_pattern_matches) {
-  if (num_guesses == max_num_guesses) {
-    // You can't solve the puzzle.
-    return std::nullopt;
+// The pattern you see when the guess is the answer.
+static constexpr int kAllGreen = kNumPatterns - 1;
+
+// The total and the largest weight of the words of a set, where the weight of
+// a word is how likely it is to be the answer. Without weights, every word
+// weighs 1.
+struct SetWeight {
+  float total;
+  float max;
+};
+
+// Returns the weight of the given words, which weigh the given weights, or 1
+// each if weights is null.
+SetWeight WeighWords(const float* weights, const int* words, int num_words) {
+  if (!weights) {
+    return SetWeight{static_cast<float>(num_words), 1};
   }
-  if (num_words_left == 1) {
-    // With only a single word left, solve right away.
-    return 1;
+  SetWeight weight = {0, 0};
+  for (int i = 0; i < num_words; ++i) {
+    weight.total += weights[words[i]];
+    weight.max = std::max(weight.max, weights[words[i]]);
   }
-  // These are the current words left.
-  const std::vector<int>& words_left = all_words_left[num_guesses - 1];
-  // This is the storage location for words left after the next guess.
-  std::vector<int>& next_words_left = all_words_left[num_guesses];
-  std::optional<float> min_expected;
-  for (int next = 0; next < num_words_left; ++next) {
-    int next_word = words_left[next];
-    float result = 0;
-    bool valid = true;
-    for (const std::vector<bool>& pattern : word_pattern_matches[next_word]) {
-      int new_num_words_left = 0;
-      for (int i = 0; i < num_words_left; ++i) {
-        int word = words_left[i];
-        if (pattern[word]) {
-          next_words_left[new_num_words_left] = word;
-          ++new_num_words_left;
-        }
+  return weight;
+}
+
+// The words left after a guess, split into one bucket for each pattern that
+// has at least one matching word.
+struct PatternBuckets {
+  int num_buckets = 0;
+  // The words of bucket b are words[start[b]] to words[start[b + 1] - 1], and
+  // all of them match patterns[b]. Buckets are in increasing pattern order.
+  Pattern patterns[kNumPatterns];
+  int start[kNumPatterns + 1];
+  SetWeight weight[kNumPatterns];
+  // Scratch space for the partitioning, indexed by pattern. It is all zeros
+  // between calls to CountPatterns and PlaceWords.
+  int count[kNumPatterns] = {};
+  SetWeight pattern_weight[kNumPatterns] = {};
+  // Storage for all the words, owned by whoever owns the buckets.
+  int* words = nullptr;
+
+  int size(int b) const { return start[b + 1] - start[b]; }
+};
+
+// Computes the buckets that the given words split into, by the pattern you
+// would see if guess is played next, without placing the words into them.
+// Bucket sizes are all that's needed to bound a guess, so guesses that get cut
+// off by their bound never pay for placing the words.
+//
+// Only the patterns that actually occur are touched, so the cost is linear in
+// num_words, no matter how many patterns are possible. The weights of the
+// buckets are summed up in the same pass, if the words have weights.
+void CountPatterns(const PatternTable& table, const float* weights, int guess,
+                   const int* words, int num_words, PatternBuckets& buckets) {
+  const Pattern* row = table.Row(guess);
+  int* count = buckets.count;
+  Pattern* patterns = buckets.patterns;
+  SetWeight* pattern_weight = buckets.pattern_weight;
+  int num_buckets = 0;
+  if (!weights) {
+    for (int i = 0; i < num_words; ++i) {
+      int pattern = row[words[i]];
+      if (count[pattern]++ == 0) {
+        patterns[num_buckets++] = pattern;
       }
-      if (new_num_words_left > 0) {
-        float expected;
-        if (next_words_left[0] == next_word) {
-          // Correct guess.
-          expected = 1;
-        } else {
-          std::optional<float> next_result =
-              Recurse(num_guesses + 1, max_num_guesses, all_words_left,
-                      new_num_words_left, word_pattern_matches);
-          if (!next_result) {
-            // If you play this word as the next word, it's not possible to
-            // always solve the puzzle.
-            valid = false;
-            break;
-          }
-          expected = 1 + *next_result;
-        }
-        result += new_num_words_left * expected;
+    }
+  } else {
+    for (int i = 0; i < num_words; ++i) {
+      int pattern = row[words[i]];
+      if (count[pattern]++ == 0) {
+        patterns[num_buckets++] = pattern;
       }
+      float weight = weights[words[i]];
+      pattern_weight[pattern].total += weight;
+      pattern_weight[pattern].max =
+          std::max(pattern_weight[pattern].max, weight);
+    }
+  }
+  // Keeping the buckets in pattern order makes the results independent of the
+  // order of the words.
+  std::sort(patterns, patterns + num_buckets);
+  int offset = 0;
+  for (int b = 0; b < num_buckets; ++b) {
+    int pattern = patterns[b];
+    buckets.start[b] = offset;
+    offset += count[pattern];
+    if (!weights) {
+      buckets.weight[b] = SetWeight{static_cast<float>(count[pattern]), 1};
+    } else {
+      buckets.weight[b] = pattern_weight[pattern];
+      pattern_weight[pattern] = SetWeight{0, 0};
     }
-    if (valid) {
-      result /= num_words_left;
+    count[pattern] = 0;
+  }
+  buckets.start[num_buckets] = offset;
+  buckets.num_buckets = num_buckets;
+}
+
+// Places the given words into the buckets computed by CountPatterns, for the
+// same guess and words. This is a counting sort, so words keep their relative
+// order within each bucket.
+void PlaceWords(const PatternTable& table, int guess, const int* words,
+                int num_words, PatternBuckets& buckets) {
+  const Pattern* row = table.Row(guess);
+  int* count = buckets.count;
+  // While placing words, count is the next position to write to in the bucket.
+  for (int b = 0; b < buckets.num_buckets; ++b) {
+    count[buckets.patterns[b]] = buckets.start[b];
+  }
+  int* out = buckets.words;
+  for (int i = 0; i < num_words; ++i) {
+    int word = words[i];
+    out[count[row[word]]++] = word;
+  }
+  for (int b = 0; b < buckets.num_buckets; ++b) {
+    count[buckets.patterns[b]] = 0;
+  }
+}
 
-      if (!min_expected || result < *min_expected) {
-        min_expected = result;
+// Whether to collect SearchStats. They are compiled out unless WORDLE_STATS is
+// defined, so the default build pays nothing for them.
+#ifdef WORDLE_STATS
+static constexpr bool kCollectStats = true;
+#else
+static constexpr bool kCollectStats = false;
+#endif
+
+// Number of bins of the histograms of bucket sizes. Bin k counts the buckets
+// with between 2^k and 2^(k + 1) - 1 words.
+static constexpr int kNumSizeBins = 16;
+
+// Counters of where the search spends its time, all indexed by the number of
+// guesses already made. Every thread has its own, so they are not atomic, and
+// they are only added up once the search is done.
+struct SearchStats {
+  explicit SearchStats(int max_num_guesses)
+      : nodes(max_num_guesses + 1),
+        cache_hits(max_num_guesses + 1),
+        guesses(max_num_guesses + 1),
+        cutoffs(max_num_guesses + 1),
+        aborts(max_num_guesses + 1),
+        bucket_sizes(max_num_guesses + 1) {}
+
+  // Adds the counters of other, which must have the same size.
+  void Add(const SearchStats& other) {
+    for (int d = 0; d < nodes.size(); ++d) {
+      nodes[d] += other.nodes[d];
+      cache_hits[d] += other.cache_hits[d];
+      guesses[d] += other.guesses[d];
+      cutoffs[d] += other.cutoffs[d];
+      aborts[d] += other.aborts[d];
+      for (int k = 0; k < kNumSizeBins; ++k) {
+        bucket_sizes[d][k] += other.bucket_sizes[d][k];
       }
     }
   }
-  return min_expected;
+
+  // Number of calls to Recurse.
+  std::vector<int64_t> nodes;
+  // Number of calls to Recurse answered by the cache.
+  std::vector<int64_t> cache_hits;
+  // Number of calls to EvaluateGuess, which is the number of guesses tried.
+  std::vector<int64_t> guesses;
+  // Number of guesses cut off by their lower bound, or because they don't tell
+  // any of the words apart, before recursing into any pattern.
+  std::vector<int64_t> cutoffs;
+  // Number of guesses abandoned after recursing into some of the patterns.
+  std::vector<int64_t> aborts;
+  // Histograms of the sizes of the buckets that guesses are recursed into.
+  std::vector<std::array<int64_t, kNumSizeBins>> bucket_sizes;
+};
+
+// Returns the bin of the histograms of bucket sizes for the given size.
+int SizeBin(int size) {
+  int bin = 0;
+  while (bin + 1 < kNumSizeBins && size >= (2 << bin)) {
+    ++bin;
+  }
+  return bin;
 }
 
-// Tries every first guess in the range [start, end).
-void Thread(
-    int start, int end, int max_num_guesses,
-    const std::vector<std::string>& words,
-    const std::vector<std::vector<std::vector<bool>>>& word_pattern_matches,
-    std::mutex& mu, std::ofstream& fout, std::optional<float>& min_expected,
-    int& best_word) {
-  // all_words_left is thread-local storage space to store the words remaining
-  // at a given recursion depth.
-  std::vector<std::vector<int>> all_words_left(max_num_guesses,
-                                               std::vector<int>(words.size()));
-  // This is the storage location for words left after the first guess.
-  std::vector<int>& next_words_left = all_words_left[0];
-  for (int first_word = start; first_word < end; ++first_word) {
-    float result = 0;
-    bool valid = true;
-    for (const std::vector<bool>& pattern : word_pattern_matches[first_word]) {
-      int new_num_words_left = 0;
-      for (int word = 0; word < words.size(); ++word) {
-        if (pattern[word]) {
-          next_words_left[new_num_words_left] = word;
-          ++new_num_words_left;
-        }
+// A guess to try, ranked by a lower bound on the sum of the expected number of
+// guesses of all words. order is the position of the guess when the guesses
+// are not ranked.
+struct RankedGuess {
+  double lower_sum;
+  int order;
+  int guess;
+};
+
+// In hard mode, every guess must be consistent with all the patterns seen so
+// far, which means it must still be possible as the answer. This is the strict
+// variant of the hard mode of the game, which only requires green letters to
+// stay in place and yellow letters to be reused. For guesses that can be the
+// answer, the allowed ones are exactly the words left. This is the set of the
+// other guesses that are still allowed, which is filtered incrementally as
+// guesses are played, so it never needs to be recomputed from scratch.
+struct AllowedGuesses {
+  // Bit g is set if guess num_answers + g is allowed.
+  std::vector<uint64_t> bits;
+  // XOR of TranspositionTable::HardGuessKey of all the allowed guesses, so
+  // the cache tells apart sets of words with different allowed guesses.
+  uint64_t key = 0;
+
+  // Calls f(g) for every allowed guess num_answers + g, in increasing order.
+  template <typename F>
+  void ForEach(F f) const {
+    for (size_t w = 0; w < bits.size(); ++w) {
+      for (uint64_t word = bits[w]; word != 0; word &= word - 1) {
+        f(static_cast<int>(w * 64 + __builtin_ctzll(word)));
       }
-      float expected;
-      if (next_words_left[0] == first_word) {
-        // Correct guess.
-        expected = 1;
-      } else {
-        std::optional<float> next_result =
-            Recurse(/*num_guesses=*/1, max_num_guesses, all_words_left,
-                    new_num_words_left, word_pattern_matches);
-        if (!next_result) {
-          // If you play this word as the first word, it's not possible to
-          // always solve the puzzle.
-          valid = false;
-          break;
-        }
-        expected = 1 + *next_result;
+    }
+  }
+};
+
+// Size of a cache line, which arrays of different threads or depths never
+// share.
+static constexpr size_t kCacheLineSize = 64;
+
+// A single block of memory, sized once, that objects are carved out of in cache
+// line aligned slices. The block is mapped but not touched when the arena is
+// created, so every page is placed on the NUMA node of the thread that first
+// writes it, by the default memory policy of Linux. Objects are never
+// destroyed, so they must be trivially destructible.
+class Arena {
+ public:
+  // Returns the number of bytes that num objects of type T take in an arena.
+  template <typename T>
+  static size_t Bytes(size_t num) {
+    return (num * sizeof(T) + kCacheLineSize - 1) / kCacheLineSize *
+           kCacheLineSize;
+  }
+
+  explicit Arena(size_t size) : size_(std::max<size_t>(size, 1)) {
+    void* data = mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+      std::cerr << "Failed to allocate " << size_ << " bytes" << std::endl;
+      std::exit(1);
+    }
+    data_ = static_cast<uint8_t*>(data);
+  }
+
+  ~Arena() { munmap(data_, size_); }
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  // Returns num default initialized objects of type T, which must fit in what
+  // is left of the arena. Types without constructors, like int, are left
+  // untouched.
+  template <typename T>
+  T* Allocate(size_t num) {
+    static_assert(std::is_trivially_destructible_v<T>);
+    size_t bytes = Bytes<T>(num);
+    assert(used_ + bytes <= size_);
+    T* objects = reinterpret_cast<T*>(data_ + used_);
+    for (size_t i = 0; i < num; ++i) {
+      new (&objects[i]) T;
+    }
+    used_ += bytes;
+    return objects;
+  }
+
+ private:
+  uint8_t* data_;
+  size_t size_;
+  size_t used_ = 0;
+};
+
+// Thread-local storage space used by the recursion. All of it is preallocated
+// in a single arena, so no memory allocations are needed inside the recursion,
+// except for the bits of all_allowed, which are sized on first use. The
+// constructor writes the buckets, so a workspace should be created by the
+// thread that uses it, see CreateWorkspaces.
+struct Workspace {
+  Workspace(int max_num_guesses, int num_words, int num_guesses)
+      : arena(max_num_guesses * (Arena::Bytes<PatternBuckets>(1) +
+                                 Arena::Bytes<int>(num_words) +
+                                 Arena::Bytes<RankedGuess>(num_guesses))),
+        all_allowed(max_num_guesses + 1),
+        stats(max_num_guesses) {
+    all_buckets = arena.Allocate<PatternBuckets>(max_num_guesses);
+    for (int d = 0; d < max_num_guesses; ++d) {
+      all_buckets[d].words = arena.Allocate<int>(num_words);
+      all_ranked.push_back(arena.Allocate<RankedGuess>(num_guesses));
+    }
+  }
+
+  // Owns all the buckets and ranked guesses.
+  Arena arena;
+  // all_buckets[d] stores the words left after d + 1 guesses, split by the
+  // pattern of the last guess.
+  PatternBuckets* all_buckets;
+  // all_ranked[d] stores the ranked guesses to try after d guesses.
+  std::vector<RankedGuess*> all_ranked;
+  // In hard mode, all_allowed[d] stores the guesses that can't be the answer
+  // but are allowed after d guesses. Unused otherwise.
+  std::vector<AllowedGuesses> all_allowed;
+  // Number of calls to Recurse, which is the number of nodes of the search.
+  // Only the thread using the workspace writes it, so it doesn't need atomic
+  // increments, but other threads may read it to report progress.
+  std::atomic<int64_t> num_nodes{0};
+  // Number of sets of words solved by SolveEndgame, each of which saves trying
+  // every guess for the set.
+  int64_t num_endgames = 0;
+  // Only updated if kCollectStats is true.
+  SearchStats stats;
+};
+
+// Cache of the results of Recurse, shared between all threads, since many
+// different sequences of guesses lead to the same set of words left.
+//
+// Each entry stores either the exact expected number of guesses for a set of
+// words, or only a lower bound on it if the search was cut off by a bound. Sets
+// that can't be solved at all have a lower bound of infinity.
+//
+// Entries are keyed by a Zobrist hash of the set of words left and the number
+// of guesses left: every word has a random 64 bit key and the key of a set is
+// the XOR of the keys of its words. The hash ignores the order of the words, so
+// it doesn't matter which guesses led to the set. Full 64 bit keys are stored,
+// which makes false matches vanishingly unlikely.
+//
+// The table has a fixed memory budget. It is split into buckets of four
+// entries that share a cache line. When a bucket is full, the entry for the
+// smallest set of words, which is the cheapest one to recompute, is evicted.
+//
+// Entries are read and written without locks. Each entry stores key ^ data
+// next to data, so an entry torn by a concurrent write simply fails to match.
+class TranspositionTable {
+ public:
+  TranspositionTable(size_t max_bytes, int num_words, int max_num_guesses) {
+    size_t num_buckets = 1;
+    while (num_buckets * 2 * sizeof(Bucket) <= max_bytes) {
+      num_buckets *= 2;
+    }
+    mask_ = num_buckets - 1;
+    buckets_.reset(new Bucket[num_buckets]());
+
+    uint64_t state = 0x9e3779b97f4a7c15;
+    word_keys_.resize(num_words);
+    for (uint64_t& key : word_keys_) {
+      key = SplitMix64(state);
+    }
+    num_guesses_keys_.resize(max_num_guesses + 1);
+    for (uint64_t& key : num_guesses_keys_) {
+      key = SplitMix64(state);
+    }
+  }
+
+  // Returns the key of the given guess that can't be the answer, where guess is
+  // its index minus the number of answers. In hard mode, the key of every
+  // allowed such guess is added to the key of the set of words.
+  static uint64_t HardGuessKey(int guess) {
+    uint64_t state = kHardGuessSeed + guess * 0x9e3779b97f4a7c15;
+    return SplitMix64(state);
+  }
+
+  // Returns the key of the given set of words, with num_guesses guesses left.
+  uint64_t Key(const int* words, int num_words, int num_guesses_left) const {
+    uint64_t key = num_guesses_keys_[num_guesses_left];
+    for (int i = 0; i < num_words; ++i) {
+      key ^= word_keys_[words[i]];
+    }
+    return key;
+  }
+
+  // Looks up the result for the given key. Returns false if it's not cached.
+  // Otherwise, value is the cached expected value if exact is true, or a lower
+  // bound on it if exact is false.
+  bool Lookup(uint64_t key, float& value, bool& exact) const {
+    const Bucket& bucket = buckets_[key & mask_];
+    for (const Entry& entry : bucket.entries) {
+      uint64_t data = entry.data.load(std::memory_order_relaxed);
+      if ((entry.key_xor_data.load(std::memory_order_relaxed) ^ data) == key) {
+        uint32_t bits = data;
+        std::memcpy(&value, &bits, sizeof(value));
+        exact = data & kExactBit;
+        return true;
       }
-      result += new_num_words_left * expected;
     }
-    if (valid) {
-      result /= words.size();
+    return false;
+  }
 
-      std::lock_guard<std::mutex> guard(mu);
-      fout << result << " " << words[first_word] << std::endl;
-      fout.flush();
+  // Saves all the entries to the given file, for the given guesses and
+  // answers. Other threads can keep using the table meanwhile, since entries
+  // torn by their writes simply fail to match once loaded.
+  void Save(const std::string& filename,
+            const std::vector<std::string>& guesses,
+            const std::vector<std::string>& answers) const {
+    std::vector<uint64_t> data;
+    data.reserve((mask_ + 1) * 8);
+    for (size_t b = 0; b <= mask_; ++b) {
+      for (const Entry& entry : buckets_[b].entries) {
+        data.push_back(entry.key_xor_data.load(std::memory_order_relaxed));
+        data.push_back(entry.data.load(std::memory_order_relaxed));
+      }
+    }
+    SaveFile(filename, kCacheMagic, kCacheVersion, guesses, answers,
+             data.data(), data.size() * sizeof(uint64_t));
+  }
 
-      if (!min_expected || result < *min_expected ||
-          (result == *min_expected && first_word < best_word)) {
-        min_expected = result;
-        best_word = first_word;
+  // Loads the entries saved by Save from the given file, replacing all the
+  // entries. The file must be for the same guesses and answers, and for a
+  // table with the same memory budget.
+  //
+  // Returns false if the file doesn't exist or doesn't match.
+  bool Load(const std::string& filename,
+            const std::vector<std::string>& guesses,
+            const std::vector<std::string>& answers) {
+    std::optional<MappedFile> file =
+        MapFile(filename, kCacheMagic, kCacheVersion, guesses, answers);
+    if (!file || file->size != (mask_ + 1) * sizeof(Bucket)) {
+      return false;
+    }
+    const uint64_t* data = reinterpret_cast<const uint64_t*>(file->data);
+    for (size_t b = 0; b <= mask_; ++b) {
+      for (Entry& entry : buckets_[b].entries) {
+        entry.key_xor_data.store(*data++, std::memory_order_relaxed);
+        entry.data.store(*data++, std::memory_order_relaxed);
       }
     }
+    return true;
   }
-}
 
-// Sorts all the results in the given file in increased order of expected value.
-void SortResults(const std::string& filename) {
-  std::ifstream fin(filename);
-  std::vector<std::pair<float, std::string>> results;
-  while (true) {
-    float expected;
-    std::string word;
-    if (!(fin >> expected >> word)) {
-      break;
+  // Stores the result for the given key of a set of num_words words.
+  void Insert(uint64_t key, int num_words, float value, bool exact) {
+    Bucket& bucket = buckets_[key & mask_];
+    Entry* victim = &bucket.entries[0];
+    int victim_num_words = std::numeric_limits<int>::max();
+    for (Entry& entry : bucket.entries) {
+      uint64_t data = entry.data.load(std::memory_order_relaxed);
+      if ((entry.key_xor_data.load(std::memory_order_relaxed) ^ data) == key) {
+        victim = &entry;
+        break;
+      }
+      int entry_num_words = data >> 40;
+      if (entry_num_words < victim_num_words) {
+        victim = &entry;
+        victim_num_words = entry_num_words;
+      }
     }
-    results.emplace_back(expected, word);
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint64_t data = bits | (exact ? kExactBit : 0) |
+                    (static_cast<uint64_t>(num_words) << 40);
+    victim->key_xor_data.store(key ^ data, std::memory_order_relaxed);
+    victim->data.store(data, std::memory_order_relaxed);
   }
-  fin.close();
-  std::sort(results.begin(), results.end());
-  std::ofstream fout(filename);
-  for (const std::pair<float, std::string>& result : results) {
-    fout << result.first << " " << result.second << std::endl;
+
+ private:
+  // The data of an entry stores the bits of the float value in the lowest 32
+  // bits, whether the value is exact in bit 32 and the number of words in the
+  // set in the highest bits. Empty entries have num_words = 0.
+  static constexpr uint64_t kExactBit = static_cast<uint64_t>(1) << 32;
+
+  // The cache file holds the two words of every entry after the header, bucket
+  // by bucket.
+  static constexpr char kCacheMagic[8] = "WRDLTTB";
+  // Must be incremented whenever the file format, the encoding of the entries
+  // or the word keys change.
+  static constexpr uint32_t kCacheVersion = 1;
+
+  // Start of the sequence of HardGuessKey, far from the one of the word keys.
+  static constexpr uint64_t kHardGuessSeed = 0x2545f4914f6cdd1d;
+
+  struct Entry {
+    std::atomic<uint64_t> key_xor_data;
+    std::atomic<uint64_t> data;
+  };
+  struct alignas(64) Bucket {
+    Entry entries[4];
+  };
+
+  static uint64_t SplitMix64(uint64_t& state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
   }
-}
 
-int main(int args, char* argv[]) {
-  static constexpr int kMaxNumGuesses = 6;
-  static constexpr int kNumThreads = 24;
+  uint64_t mask_;
+  std::unique_ptr<Bucket[]> buckets_;
+  std::vector<uint64_t> word_keys_;
+  std::vector<uint64_t> num_guesses_keys_;
+};
 
-  int max_num_guesses = kMaxNumGuesses;
+// Sets of fewer words than this are not cached, since recomputing them is
+// about as cheap as looking them up.
+static constexpr int kMinCachedWords = 4;
 
-  std::vector<std::string> words = ReadWords();
-  std::vector<std::vector<std::vector<bool>>> all_word_pattern_matches =
-      ComputeWordPatternMatches(words);
+// Sets of at most this many words are solved by SolveEndgame whenever possible.
+static constexpr int kMaxEndgameWords = 5;
 
-  // Applies any guesses already made by prunning the list of words.
-  assert((args - 1) % 2 == 0);
-  for (int guess_i = 0; guess_i < (args - 1) / 2; ++guess_i) {
-    std::string guess = argv[1 + guess_i * 2];
-    std::string pattern = argv[1 + guess_i * 2 + 1];
+// Guesses for sets of fewer words than this are tried in their natural order
+// instead of being ranked, since ranking them costs about as much as trying
+// them.
+static constexpr int kMinRankedWords = 8;
 
-    int word_i = std::find(words.begin(), words.end(), guess) - words.begin();
-    assert(word_i != words.size());
+// A guess is only cut off once it's worse than the best guess so far by more
+// than this margin. That way float rounding in the bounds can never cut off a
+// guess that would have been chosen, and ties are still broken as without any
+// bounds.
+static constexpr double kBoundSlack = 1e-4;
 
-    int pattern_int = ToPatternInt(pattern);
-    const std::vector<bool>& matches =
-        all_word_pattern_matches[word_i][pattern_int];
+// Number of guesses the game allows.
+static constexpr int kDefaultMaxNumGuesses = 6;
+
+// What the search optimizes. See the objective policies below.
+enum class ObjectiveKind {
+  // Minimizes the expected number of guesses.
+  kExpected,
+  // Minimizes the number of guesses in the worst case.
+  kWorstCase,
+  // Maximizes the probability of winning within max_num_guesses guesses.
+  kWinRate,
+};
+
+// Everything the search needs that stays the same during the whole search.
+struct SearchContext {
+  int max_num_guesses;
+  const PatternTable* table;
+  // If not null, results are looked up in and saved to the cache.
+  TranspositionTable* cache = nullptr;
+  // If positive, only this many of the best ranked guesses are tried for every
+  // set of words that is ranked after the first guess of the search. This is
+  // much faster, but the expected values are only upper bounds on the optimal
+  // ones. They are still saved in the cache as exact values, so a cache must
+  // never be shared by searches with different beam widths. The checkpoint
+  // header includes the beam width, which guards the saved cache.
+  int beam_width = 0;
+  // If not null, the weight of every answer, which is how likely it is to be
+  // the answer, so the expected values are weighted by them. The weights are
+  // scaled to average 1. If null, every answer is equally likely.
+  const float* weights = nullptr;
+  // If not null, the search is in hard mode, and this is the pattern table of
+  // every guess against every guess that can't be the answer, which is used to
+  // filter the allowed guesses. See AllowedGuesses.
+  const PatternTable* hard_table = nullptr;
+  ObjectiveKind objective = ObjectiveKind::kExpected;
+};
 
-    std::vector<std::string> new_words;
-    for (int i = 0; i < words.size(); ++i) {
-      if (matches[i]) {
-        new_words.push_back(words[i]);
+// Sets to the guesses in from that are still allowed in hard mode if guess is
+// played and the response is the given pattern.
+void FilterAllowed(const PatternTable& hard_table, int guess, int pattern,
+                   const AllowedGuesses& from, AllowedGuesses& to) {
+  const Pattern* row = hard_table.Row(guess);
+  to.bits.assign(from.bits.size(), 0);
+  to.key = 0;
+  from.ForEach([&](int g) {
+    if (row[g] == pattern) {
+      to.bits[g / 64] |= static_cast<uint64_t>(1) << (g % 64);
+      to.key ^= TranspositionTable::HardGuessKey(g);
+    }
+  });
+}
+
+// Checks that every one of the given guesses already made, which must be valid
+// for ApplyGuesses, is allowed in hard mode, and sets allowed to the guesses
+// that can't be the answer but are allowed after all of them.
+//
+// Returns false if any guess isn't consistent with the patterns before it.
+bool ApplyHardMode(const std::vector<std::string>& guess_words,
+                   const PatternTable& table, const PatternTable& hard_table,
+                   const std::vector<std::string>& guesses,
+                   AllowedGuesses& allowed, std::string& error) {
+  allowed.bits.assign((hard_table.num_answers + 63) / 64, 0);
+  allowed.key = 0;
+  for (int g = 0; g < hard_table.num_answers; ++g) {
+    allowed.bits[g / 64] |= static_cast<uint64_t>(1) << (g % 64);
+    allowed.key ^= TranspositionTable::HardGuessKey(g);
+  }
+  std::vector<std::pair<int, int>> played;
+  for (int guess_i = 0; guess_i < guesses.size() / 2; ++guess_i) {
+    int word_i =
+        std::find(guess_words.begin(), guess_words.end(),
+                  guesses[guess_i * 2]) -
+        guess_words.begin();
+    int pattern = ToPatternInt(guesses[guess_i * 2 + 1]);
+    for (const auto& [guess, guess_pattern] : played) {
+      int actual = word_i < table.num_answers
+                       ? table.Row(guess)[word_i]
+                       : hard_table.Row(guess)[word_i - table.num_answers];
+      if (actual != guess_pattern) {
+        error = "Not allowed in strict hard mode: " + guesses[guess_i * 2];
+        return false;
       }
     }
+    played.emplace_back(word_i, pattern);
+    AllowedGuesses next;
+    FilterAllowed(hard_table, word_i, pattern, allowed, next);
+    allowed = std::move(next);
+  }
+  return true;
+}
 
-    words = new_words;
-    all_word_pattern_matches = ComputeWordPatternMatches(words);
-    --max_num_guesses;
-    assert(!words.empty());
+// Returns a lower bound on the expected number of guesses you need to make to
+// win with num_words words of the given weight left and num_guesses_left
+// guesses left. It's 1 for a single word. Otherwise, at best the next guess is
+// the heaviest word, which is correct with probability weight.max /
+// weight.total, and every other word needs exactly one more guess, which gives
+// 2 - weight.max / weight.total. Without weights, that's 2 - 1 / num_words.
+// With fewer guesses left than that, it's infinity.
+double ExpectedLowerBound(int num_words, SetWeight weight,
+                          int num_guesses_left) {
+  if (num_guesses_left == 0) {
+    return std::numeric_limits<double>::infinity();
+  }
+  if (num_words == 1) {
+    return 1;
+  }
+  if (num_guesses_left == 1) {
+    return std::numeric_limits<double>::infinity();
   }
-  assert(max_num_guesses > 0);
+  return 2 - static_cast<double>(weight.max) / weight.total;
+}
 
-  std::vector<std::vector<std::vector<bool>>> word_pattern_matches =
-      TrimWordPatternMatches(all_word_pattern_matches);
+// Adds the value of a pattern of the given weight to sum, which combines the
+// values of all the patterns of a guess: the largest value for worst case
+// objectives, and otherwise the sum of the values multiplied by the weights.
+template <typename Objective>
+void AddBucket(double& sum, SetWeight weight, double value) {
+  if constexpr (Objective::kWorstCase) {
+    sum = std::max(sum, value);
+  } else {
+    sum += weight.total * value;
+  }
+}
 
-  std::vector<std::unique_ptr<std::thread>> threads;
-  std::mutex mu;
-  std::stringstream sout;
-  sout << "result" << (kMaxNumGuesses - max_num_guesses + 1) << ".txt";
-  std::ofstream fout(sout.str());
-  std::cout << "Saving results in: " << sout.str() << std::endl;
-  std::optional<float> min_expected;
-  int best_word;
-  for (int thread = 0; thread < kNumThreads; ++thread) {
-    int start = words.size() * thread / kNumThreads;
-    int end = words.size() * (thread + 1) / kNumThreads;
-    threads.emplace_back(new std::thread([start, end, max_num_guesses, &words,
-                                          &word_pattern_matches, &mu, &fout,
-                                          &min_expected, &best_word]() {
-      Thread(start, end, max_num_guesses, words, word_pattern_matches, mu, fout,
-             min_expected, best_word);
-    }));
-  }
-  for (const auto& thread : threads) {
-    thread->join();
+// Returns the bound on the combined values of AddBucket for a set of the given
+// weight, if the value of the set must be less than bound.
+template <typename Objective>
+double BoundSum(double bound, SetWeight weight) {
+  if constexpr (Objective::kWorstCase) {
+    return bound;
+  } else {
+    return bound * weight.total;
   }
-  std::cout << "Computation is done. ";
-  if (!min_expected) {
-    std::cout << "You can't win!" << std::endl;
+}
+
+// Returns the lower bound on the value of guess, combined over all the given
+// words by AddBucket, if guess is played with num_guesses_left guesses left
+// after it. Every pattern is bounded using Objective::LowerBound.
+template <typename Objective>
+double GuessLowerSum(const PatternTable& table, const float* weights,
+                     int guess, const int* words, int num_words,
+                     int num_guesses_left, PatternBuckets& buckets) {
+  const Pattern* row = table.Row(guess);
+  int* count = buckets.count;
+  Pattern* patterns = buckets.patterns;
+  SetWeight* pattern_weight = buckets.pattern_weight;
+  int num_patterns = 0;
+  if (!weights) {
+    for (int i = 0; i < num_words; ++i) {
+      int pattern = row[words[i]];
+      if (count[pattern]++ == 0) {
+        patterns[num_patterns++] = pattern;
+      }
+    }
   } else {
-    std::cout << "Play the word: " << words[best_word] << std::endl;
+    for (int i = 0; i < num_words; ++i) {
+      int pattern = row[words[i]];
+      if (count[pattern]++ == 0) {
+        patterns[num_patterns++] = pattern;
+      }
+      float weight = weights[words[i]];
+      pattern_weight[pattern].total += weight;
+      pattern_weight[pattern].max =
+          std::max(pattern_weight[pattern].max, weight);
+    }
+  }
+  double lower_sum = 0;
+  for (int p = 0; p < num_patterns; ++p) {
+    int pattern = patterns[p];
+    int size = count[pattern];
+    count[pattern] = 0;
+    SetWeight weight = SetWeight{static_cast<float>(size), 1};
+    if (weights) {
+      weight = pattern_weight[pattern];
+      pattern_weight[pattern] = SetWeight{0, 0};
+    }
+    if (pattern == kAllGreen) {
+      AddBucket<Objective>(lower_sum, weight, Objective::kGuessValue);
+    } else {
+      AddBucket<Objective>(
+          lower_sum, weight,
+          Objective::kGuessValue +
+              Objective::LowerBound(size, weight, num_guesses_left));
+    }
+  }
+  return lower_sum;
+}
+
+// Calls evaluate(guess, order) for every guess worth trying with the given
+// words left, which must be in increasing order, in their natural order.
+// evaluate returns the bound that later guesses need to beat. order is the
+// position of the guess in the natural order: first the words left, in order.
+// Then, if the table has guesses that can never be the answer, every other
+// guess. Such a guess is not one of the words left, so every word needs at
+// least one more guess after it, and it can't beat a bound of
+// Objective::kOtherGuessBound or less. If allowed is not null, the search is in
+// hard mode, and the other guesses are only the allowed ones.
+template <typename Objective, typename Evaluate>
+void ForEachGuessInOrder(const PatternTable& table,
+                         const AllowedGuesses* allowed, const int* words_left,
+                         int num_words_left, Evaluate evaluate) {
+  double bound = std::numeric_limits<double>::infinity();
+  for (int i = 0; i < num_words_left; ++i) {
+    bound = evaluate(words_left[i], i);
+  }
+  if (table.num_guesses == table.num_answers) {
+    return;
+  }
+  if (allowed) {
+    allowed->ForEach([&](int g) {
+      if (bound > Objective::kOtherGuessBound) {
+        bound = evaluate(table.num_answers + g, num_words_left + g);
+      }
+    });
+    return;
+  }
+  int i = 0;
+  for (int guess = 0;
+       guess < table.num_guesses && bound > Objective::kOtherGuessBound;
+       ++guess) {
+    if (i < num_words_left && words_left[i] == guess) {
+      ++i;
+    } else {
+      bound = evaluate(guess, num_words_left + guess - i);
+    }
+  }
+}
+
+// Same as ForEachGuessInOrder, once num_guesses guesses have already been
+// made. Ties must still be broken by the natural order.
+//
+// For sets of at least kMinRankedWords words, guesses are tried best first, by
+// the lower bound of GuessLowerSum. Good guesses found early give tight bounds,
+// which cut off most other guesses right away. Because guesses are sorted by
+// the same lower bound that EvaluateGuess checks first, all guesses after the
+// first one that can't beat the bound are skipped at once.
+template <typename Objective, typename Evaluate>
+void ForEachGuess(const SearchContext& search, int num_guesses,
+                  Workspace& workspace, const int* words_left,
+                  int num_words_left, SetWeight weight, Evaluate evaluate) {
+  const PatternTable& table = *search.table;
+  const AllowedGuesses* allowed =
+      search.hard_table ? &workspace.all_allowed[num_guesses] : nullptr;
+  if (num_words_left < kMinRankedWords) {
+    ForEachGuessInOrder<Objective>(table, allowed, words_left, num_words_left,
+                                   evaluate);
+    return;
   }
-  fout.close();
 
-  SortResults(sout.str());
+  RankedGuess* ranked = workspace.all_ranked[num_guesses];
+  PatternBuckets& buckets = workspace.all_buckets[num_guesses];
+  int num_guesses_left = search.max_num_guesses - num_guesses - 1;
+  int num_ranked = 0;
+  auto rank = [&](int guess, int order) {
+    double lower_sum =
+        GuessLowerSum<Objective>(table, search.weights, guess, words_left,
+                                 num_words_left, num_guesses_left, buckets);
+    if (lower_sum < std::numeric_limits<double>::infinity()) {
+      ranked[num_ranked++] = RankedGuess{lower_sum, order, guess};
+    }
+  };
+  for (int i = 0; i < num_words_left; ++i) {
+    rank(words_left[i], i);
+  }
+  if (allowed) {
+    allowed->ForEach([&](int g) {
+      rank(table.num_answers + g, num_words_left + g);
+    });
+  } else if (table.num_guesses != table.num_answers) {
+    int i = 0;
+    for (int guess = 0; guess < table.num_guesses; ++guess) {
+      if (i < num_words_left && words_left[i] == guess) {
+        ++i;
+      } else {
+        rank(guess, num_words_left + guess - i);
+      }
+    }
+  }
+  std::sort(ranked, ranked + num_ranked,
+            [](const RankedGuess& a, const RankedGuess& b) {
+              return std::tie(a.lower_sum, a.order) <
+                     std::tie(b.lower_sum, b.order);
+            });
+  // Every guess is tried at the root, as in a sweep over all the first words.
+  if (search.beam_width > 0 && num_guesses > 0) {
+    num_ranked = std::min(num_ranked, search.beam_width);
+  }
+  double bound = std::numeric_limits<double>::infinity();
+  for (int r = 0; r < num_ranked; ++r) {
+    const RankedGuess& guess = ranked[r];
+    if (guess.lower_sum >= BoundSum<Objective>(bound, weight)) {
+      break;
+    }
+    if (guess.order >= num_words_left && bound <= Objective::kOtherGuessBound) {
+      continue;
+    }
+    bound = evaluate(guess.guess, guess.order);
+  }
+}
+
+// Value of the template parameter kGuessesLeft of Recurse and EvaluateGuess for
+// any number of guesses left, which is then computed at runtime.
+static constexpr int kAnyGuessesLeft = -1;
+
+template <typename Objective, int kGuessesLeft>
+std::optional<float> Recurse(const SearchContext& search, int num_guesses,
+                             Workspace& workspace, const int* words_left,
+                             int num_words_left, SetWeight weight,
+                             double bound);
+
+// Same as Recurse, specialized on the number of guesses left, if it's small.
+// The last levels of the search have by far the most nodes, so they get their
+// own copies, with the number of guesses left known at compile time.
+template <typename Objective>
+std::optional<float> RecurseWithGuessesLeft(const SearchContext& search,
+                                            int num_guesses,
+                                            Workspace& workspace,
+                                            const int* words_left,
+                                            int num_words_left,
+                                            SetWeight weight, double bound) {
+  switch (search.max_num_guesses - num_guesses) {
+    case 1:
+      return Recurse<Objective, 1>(search, num_guesses, workspace, words_left,
+                                   num_words_left, weight, bound);
+    case 2:
+      return Recurse<Objective, 2>(search, num_guesses, workspace, words_left,
+                                   num_words_left, weight, bound);
+    case 3:
+      return Recurse<Objective, 3>(search, num_guesses, workspace, words_left,
+                                   num_words_left, weight, bound);
+    default:
+      return Recurse<Objective, kAnyGuessesLeft>(search, num_guesses,
+                                                 workspace, words_left,
+                                                 num_words_left, weight,
+                                                 bound);
+  }
+}
+
+// Returns whether guess gives a different pattern for every one of the given
+// words, which is a single pass that marks the patterns seen.
+bool SplitsAll(const PatternTable& table, int guess, const int* words,
+               int num_words) {
+  if (num_words > kNumPatterns) {
+    return false;
+  }
+  const Pattern* row = table.Row(guess);
+  uint64_t seen[(kNumPatterns + 63) / 64] = {};
+  for (int i = 0; i < num_words; ++i) {
+    int pattern = row[words[i]];
+    uint64_t bit = static_cast<uint64_t>(1) << (pattern % 64);
+    if (seen[pattern / 64] & bit) {
+      return false;
+    }
+    seen[pattern / 64] |= bit;
+  }
+  return true;
+}
+
+// Returns whether any guess that can be played with the given words left and
+// isn't one of them splits all the words. If allowed is not null, the search is
+// in hard mode, and only the allowed guesses are considered.
+bool OtherGuessSplitsAll(const PatternTable& table,
+                         const AllowedGuesses* allowed, const int* words_left,
+                         int num_words_left) {
+  if (allowed) {
+    bool splits = false;
+    allowed->ForEach([&](int g) {
+      splits = splits || SplitsAll(table, table.num_answers + g, words_left,
+                                   num_words_left);
+    });
+    return splits;
+  }
+  if (table.num_guesses != table.num_answers) {
+    // The words left don't need to be skipped, since the result only matters
+    // if none of them splits all the words.
+    for (int guess = 0; guess < table.num_guesses; ++guess) {
+      if (SplitsAll(table, guess, words_left, num_words_left)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Computes the expected number of guesses you need to make to win with a small
+// set of words left in closed form, without trying the guesses one by one. The
+// set must have between 2 and kMaxEndgameWords words, and ExpectedLowerBound
+// must be finite for it. The result is exactly the value Recurse would compute
+// with an infinite bound, or infinity if the set can't be solved.
+//
+// If allowed is not null, the search is in hard mode, and only the allowed
+// guesses that can't be the answer are considered.
+//
+// Returns false if the set needs the full search.
+bool SolveExpectedEndgame(const PatternTable& table, const float* weights,
+                          const AllowedGuesses* allowed, int num_guesses_left,
+                          const int* words_left, int num_words_left,
+                          SetWeight weight, float& expected) {
+  if (weights) {
+    // Only the heaviest words meet the lower bound if they split all the words.
+    for (int i = 0; i < num_words_left; ++i) {
+      if (weights[words_left[i]] == weight.max &&
+          SplitsAll(table, words_left[i], words_left, num_words_left)) {
+        expected = (weight.max + 2 * (weight.total - weight.max)) /
+                   weight.total;
+        return true;
+      }
+    }
+    return false;
+  }
+  // With a word left that splits all the words, every other word needs exactly
+  // one more guess, which meets the lower bound. That's always the case for 2
+  // words.
+  for (int i = 0; i < num_words_left; ++i) {
+    if (SplitsAll(table, words_left[i], words_left, num_words_left)) {
+      expected = (1 + 2 * (num_words_left - 1)) /
+                 static_cast<float>(num_words_left);
+      return true;
+    }
+  }
+  if (num_words_left != 3) {
+    return false;
+  }
+  // None of the 3 words tells the other 2 apart. With 3 guesses left, the first
+  // word is correct with probability 1 / 3, or else leaves 2 words, which gives
+  // (1 + 2 * 2.5) / 3. A guess that can't be the answer and splits all 3 words
+  // gives 2 as well, so it only matters with 2 guesses left.
+  expected = 2;
+  if (num_guesses_left >= 3 ||
+      OtherGuessSplitsAll(table, allowed, words_left, num_words_left)) {
+    return true;
+  }
+  expected = std::numeric_limits<float>::infinity();
+  return true;
+}
+
+// The search is specialized for each objective by an objective policy, which
+// is a template parameter of the recursion, so each objective compiles into its
+// own search without any runtime branching on it. Every policy minimizes the
+// value of a set of words, which is what Recurse returns, and has:
+//
+//   kWorstCase          = whether the value of a guess is the largest value of
+//                         its patterns, instead of their average weighted by
+//                         the weights of the words.
+//   kGuessValue         = what every guess adds to the value of its patterns,
+//                         which is also the value of the pattern where the
+//                         guess is correct.
+//   kLost               = the value of a set that can't be won anymore.
+//   kOtherGuessBound    = bound that a guess that can't be the answer can never
+//                         beat.
+//   LowerBound(...)     = a lower bound on the value of a set of words, with
+//                         the same arguments as ExpectedLowerBound.
+//   SolveEndgame(...)   = computes the exact value of a set without the search,
+//                         with the same arguments as SolveExpectedEndgame, or
+//                         returns false if it can't.
+//   SolveLastTwo(...)   = same as SolveEndgame, for a set of any size with
+//                         exactly 2 guesses left, where the next guess is the
+//                         last one that can tell words apart.
+
+// Minimizes the expected number of guesses you need to make to win.
+struct MinExpectedGuesses {
+  static constexpr bool kWorstCase = false;
+  static constexpr float kGuessValue = 1;
+  static constexpr float kLost = std::numeric_limits<float>::infinity();
+  static constexpr double kOtherGuessBound = 2;
+
+  static double LowerBound(int num_words, SetWeight weight,
+                           int num_guesses_left) {
+    return ExpectedLowerBound(num_words, weight, num_guesses_left);
+  }
+
+  static bool SolveEndgame(const PatternTable& table, const float* weights,
+                           const AllowedGuesses* allowed, int num_guesses_left,
+                           const int* words_left, int num_words_left,
+                           SetWeight weight, float& value) {
+    return num_words_left <= kMaxEndgameWords &&
+           SolveExpectedEndgame(table, weights, allowed, num_guesses_left,
+                                words_left, num_words_left, weight, value);
+  }
+
+  // The next guess must split all the words, so every other word is found with
+  // the last guess. The best such guess is the heaviest word left, or else any
+  // other guess, which gives 2. The sum over the patterns only has small
+  // integers without weights, so the result is exactly what EvaluateGuess
+  // would compute.
+  static bool SolveLastTwo(const PatternTable& table, const float* weights,
+                           const AllowedGuesses* allowed,
+                           const int* words_left, int num_words_left,
+                           SetWeight weight, float& value) {
+    std::optional<float> heaviest;
+    for (int i = 0; i < num_words_left; ++i) {
+      float word_weight = weights ? weights[words_left[i]] : 1;
+      if ((!heaviest || word_weight > *heaviest) &&
+          SplitsAll(table, words_left[i], words_left, num_words_left)) {
+        heaviest = word_weight;
+        if (!weights) {
+          break;
+        }
+      }
+    }
+    if (heaviest) {
+      value = (*heaviest + 2 * (weight.total - *heaviest)) / weight.total;
+    } else if (OtherGuessSplitsAll(table, allowed, words_left,
+                                   num_words_left)) {
+      value = 2;
+    } else {
+      value = std::numeric_limits<float>::infinity();
+    }
+    return true;
+  }
+};
+
+// Minimizes the number of guesses you need to make to win in the worst case,
+// ignoring the weights. Any pattern that can't beat the bound cuts off the
+// guess right away, since the other patterns can't make up for it.
+struct MinWorstCaseGuesses {
+  static constexpr bool kWorstCase = true;
+  static constexpr float kGuessValue = 1;
+  static constexpr float kLost = std::numeric_limits<float>::infinity();
+  static constexpr double kOtherGuessBound = 2;
+
+  // Any set of more than one word needs 2 guesses in the worst case.
+  static double LowerBound(int num_words, SetWeight /*weight*/,
+                           int num_guesses_left) {
+    if (num_guesses_left == 0) {
+      return std::numeric_limits<double>::infinity();
+    }
+    if (num_words == 1) {
+      return 1;
+    }
+    if (num_guesses_left == 1) {
+      return std::numeric_limits<double>::infinity();
+    }
+    return 2;
+  }
+
+  // A word left that splits all the words meets the lower bound.
+  static bool SolveEndgame(const PatternTable& table, const float* /*weights*/,
+                           const AllowedGuesses* /*allowed*/,
+                           int /*num_guesses_left*/, const int* words_left,
+                           int num_words_left, SetWeight /*weight*/,
+                           float& value) {
+    if (num_words_left > kMaxEndgameWords) {
+      return false;
+    }
+    for (int i = 0; i < num_words_left; ++i) {
+      if (SplitsAll(table, words_left[i], words_left, num_words_left)) {
+        value = 2;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // The next guess must split all the words.
+  static bool SolveLastTwo(const PatternTable& table, const float* /*weights*/,
+                           const AllowedGuesses* allowed,
+                           const int* words_left, int num_words_left,
+                           SetWeight /*weight*/, float& value) {
+    value = std::numeric_limits<float>::infinity();
+    for (int i = 0; i < num_words_left; ++i) {
+      if (SplitsAll(table, words_left[i], words_left, num_words_left)) {
+        value = 2;
+        return true;
+      }
+    }
+    if (OtherGuessSplitsAll(table, allowed, words_left, num_words_left)) {
+      value = 2;
+    }
+    return true;
+  }
+};
+
+// Maximizes the probability of winning within max_num_guesses guesses, by
+// minimizing the probability of not winning, weighted by the weights.
+struct MaxWinRate {
+  static constexpr bool kWorstCase = false;
+  static constexpr float kGuessValue = 0;
+  static constexpr float kLost = 1;
+  static constexpr double kOtherGuessBound = 0;
+
+  // With one guess left, you only win if it's the answer, at best the heaviest
+  // word. With more, you may always win.
+  static double LowerBound(int num_words, SetWeight weight,
+                           int num_guesses_left) {
+    if (num_guesses_left == 0) {
+      return 1;
+    }
+    if (num_words == 1) {
+      return 0;
+    }
+    if (num_guesses_left == 1) {
+      return 1 - static_cast<double>(weight.max) / weight.total;
+    }
+    return 0;
+  }
+
+  // The lower bound is exact with one guess left, for any number of words, and
+  // with more guesses left if a word left splits all the words.
+  static bool SolveEndgame(const PatternTable& table, const float* /*weights*/,
+                           const AllowedGuesses* /*allowed*/,
+                           int num_guesses_left, const int* words_left,
+                           int num_words_left, SetWeight weight,
+                           float& value) {
+    if (num_guesses_left == 1) {
+      value = (weight.total - weight.max) / weight.total;
+      return true;
+    }
+    if (num_words_left > kMaxEndgameWords) {
+      return false;
+    }
+    for (int i = 0; i < num_words_left; ++i) {
+      if (SplitsAll(table, words_left[i], words_left, num_words_left)) {
+        value = 0;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Sets that can't be split by the next guess may still be won with some
+  // probability, which depends on the heaviest word of every pattern, so they
+  // need the search.
+  static bool SolveLastTwo(const PatternTable& /*table*/,
+                           const float* /*weights*/,
+                           const AllowedGuesses* /*allowed*/,
+                           const int* /*words_left*/, int /*num_words_left*/,
+                           SetWeight /*weight*/, float& /*value*/) {
+    return false;
+  }
+};
+
+// Calls f with the policy of the objective of the given search, and returns
+// what it returns.
+template <typename F>
+auto WithObjective(const SearchContext& search, F f) {
+  switch (search.objective) {
+    case ObjectiveKind::kWorstCase:
+      return f(MinWorstCaseGuesses());
+    case ObjectiveKind::kWinRate:
+      return f(MaxWinRate());
+    case ObjectiveKind::kExpected:
+      break;
+  }
+  return f(MinExpectedGuesses());
+}
+
+// Computes the value of the given guess for the objective, e.g. the expected
+// number of guesses you need to make to win, including the given guess, if
+// guess is played once num_guesses guesses have already been made and the given
+// words, of the given weight, are left.
+//
+// Returns std::nullopt if the value is not less than bound, in which case the
+// computation is abandoned as early as possible. Before recursing into any of
+// the patterns, the value is bounded using Objective::LowerBound for every
+// pattern. Then, as the patterns are computed exactly one by one, each
+// recursion gets the bound that its pattern must beat for the guess to still
+// beat bound.
+//
+// kGuessesLeft is the number of guesses left, including the given guess, if
+// it's known at compile time, or kAnyGuessesLeft.
+template <typename Objective, int kGuessesLeft>
+std::optional<float> EvaluateGuess(const SearchContext& search,
+                                   int num_guesses, Workspace& workspace,
+                                   int guess, const int* words_left,
+                                   int num_words_left, SetWeight weight,
+                                   double bound) {
+  const PatternTable& table = *search.table;
+  SearchStats& stats = workspace.stats;
+  if constexpr (kCollectStats) {
+    ++stats.guesses[num_guesses];
+  }
+  // This is the storage location for words left after the guess.
+  PatternBuckets& buckets = workspace.all_buckets[num_guesses];
+  CountPatterns(table, search.weights, guess, words_left, num_words_left,
+                buckets);
+  if (buckets.num_buckets == 1 && buckets.patterns[0] != kAllGreen) {
+    // The guess doesn't tell any of the words apart.
+    if constexpr (kCollectStats) {
+      ++stats.cutoffs[num_guesses];
+    }
+    return std::nullopt;
+  }
+
+  // Lower bound on the values of all patterns combined by AddBucket, e.g. on
+  // the sum of the expected values of all words, multiplied by their weights.
+  // For objectives that aren't worst case, patterns that have already been
+  // computed contribute their exact value.
+  int num_guesses_left = kGuessesLeft == kAnyGuessesLeft
+                             ? search.max_num_guesses - num_guesses - 1
+                             : kGuessesLeft - 1;
+  double lower_sum = 0;
+  for (int b = 0; b < buckets.num_buckets; ++b) {
+    SetWeight bucket_weight = buckets.weight[b];
+    if (buckets.patterns[b] == kAllGreen) {
+      AddBucket<Objective>(lower_sum, bucket_weight, Objective::kGuessValue);
+    } else {
+      AddBucket<Objective>(lower_sum, bucket_weight,
+                           Objective::kGuessValue +
+                               Objective::LowerBound(buckets.size(b),
+                                                     bucket_weight,
+                                                     num_guesses_left));
+    }
+  }
+  double bound_sum = BoundSum<Objective>(bound, weight);
+  if (lower_sum >= bound_sum) {
+    if constexpr (kCollectStats) {
+      ++stats.cutoffs[num_guesses];
+    }
+    return std::nullopt;
+  }
+  PlaceWords(table, guess, words_left, num_words_left, buckets);
+  if constexpr (kCollectStats) {
+    for (int b = 0; b < buckets.num_buckets; ++b) {
+      ++stats.bucket_sizes[num_guesses][SizeBin(buckets.size(b))];
+    }
+  }
+
+  float result = 0;
+  for (int b = 0; b < buckets.num_buckets; ++b) {
+    const int* new_words_left = &buckets.words[buckets.start[b]];
+    int new_num_words_left = buckets.start[b + 1] - buckets.start[b];
+    SetWeight new_weight = buckets.weight[b];
+    float expected;
+    if (new_words_left[0] == guess) {
+      // Correct guess.
+      expected = Objective::kGuessValue;
+    } else {
+      double lower = 0;
+      double new_bound;
+      if constexpr (Objective::kWorstCase) {
+        // Every pattern must beat the bound on its own.
+        new_bound = bound - Objective::kGuessValue;
+      } else {
+        lower = new_weight.total *
+                (Objective::kGuessValue +
+                 Objective::LowerBound(new_num_words_left, new_weight,
+                                       num_guesses_left));
+        new_bound = (bound_sum - (lower_sum - lower)) / new_weight.total -
+                    Objective::kGuessValue;
+      }
+      if (search.hard_table && new_num_words_left > 2) {
+        // Sets of 2 words never need a guess that can't be the answer.
+        FilterAllowed(*search.hard_table, guess, buckets.patterns[b],
+                      workspace.all_allowed[num_guesses],
+                      workspace.all_allowed[num_guesses + 1]);
+      }
+      std::optional<float> next_result;
+      if constexpr (kGuessesLeft > 1) {
+        next_result = Recurse<Objective, kGuessesLeft - 1>(
+            search, num_guesses + 1, workspace, new_words_left,
+            new_num_words_left, new_weight, new_bound);
+      } else {
+        // Either the number of guesses left isn't known, or there are none
+        // left after this guess, which is rare enough to not specialize.
+        next_result = RecurseWithGuessesLeft<Objective>(
+            search, num_guesses + 1, workspace, new_words_left,
+            new_num_words_left, new_weight, new_bound);
+      }
+      if (!next_result) {
+        // If you play this word, it's either not possible to always solve the
+        // puzzle or it's not possible to beat the bound.
+        if constexpr (kCollectStats) {
+          ++stats.aborts[num_guesses];
+        }
+        return std::nullopt;
+      }
+      expected = Objective::kGuessValue + *next_result;
+      if constexpr (!Objective::kWorstCase) {
+        lower_sum += new_weight.total * expected - lower;
+      }
+    }
+    if constexpr (Objective::kWorstCase) {
+      result = std::max(result, expected);
+    } else {
+      result += new_weight.total * expected;
+    }
+  }
+  if constexpr (!Objective::kWorstCase) {
+    result /= weight.total;
+  }
+  if (result >= bound) {
+    if constexpr (kCollectStats) {
+      ++stats.aborts[num_guesses];
+    }
+    return std::nullopt;
+  }
+  return result;
+}
+
+// Computes the value of the given words for the objective, e.g. the expected
+// number of guesses you need to make to win, once num_guesses guesses have
+// already been made and the given words, of the given weight, are left.
+//
+// Returns std::nullopt if the value is not less than bound. Use an infinite
+// bound to get the exact value for any set of words that can be solved.
+//
+// kGuessesLeft is the number of guesses left if it's known at compile time, or
+// kAnyGuessesLeft. Use RecurseWithGuessesLeft to pick it.
+template <typename Objective, int kGuessesLeft>
+std::optional<float> Recurse(const SearchContext& search, int num_guesses,
+                             Workspace& workspace, const int* words_left,
+                             int num_words_left, SetWeight weight,
+                             double bound) {
+  workspace.num_nodes.store(
+      workspace.num_nodes.load(std::memory_order_relaxed) + 1,
+      std::memory_order_relaxed);
+  if constexpr (kCollectStats) {
+    ++workspace.stats.nodes[num_guesses];
+  }
+  int num_guesses_left = kGuessesLeft == kAnyGuessesLeft
+                             ? search.max_num_guesses - num_guesses
+                             : kGuessesLeft;
+  if (Objective::LowerBound(num_words_left, weight, num_guesses_left) >=
+      bound) {
+    // You can't solve the puzzle, or you can't beat the bound.
+    return std::nullopt;
+  }
+  if (num_guesses_left == 0) {
+    // Only reached if the value of losing is finite.
+    return Objective::kLost;
+  }
+  if (num_words_left == 1) {
+    // With only a single word left, solve right away.
+    return Objective::kGuessValue;
+  }
+  const AllowedGuesses* allowed =
+      search.hard_table ? &workspace.all_allowed[num_guesses] : nullptr;
+  float endgame;
+  bool solved = false;
+  if constexpr (kGuessesLeft == 2) {
+    solved = Objective::SolveLastTwo(*search.table, search.weights, allowed,
+                                     words_left, num_words_left, weight,
+                                     endgame);
+  }
+  if (solved ||
+      Objective::SolveEndgame(*search.table, search.weights, allowed,
+                              num_guesses_left, words_left, num_words_left,
+                              weight, endgame)) {
+    ++workspace.num_endgames;
+    if (endgame >= bound) {
+      return std::nullopt;
+    }
+    return endgame;
+  }
+  TranspositionTable* cache = search.cache;
+  uint64_t key;
+  if (cache && num_words_left >= kMinCachedWords) {
+    key = cache->Key(words_left, num_words_left, num_guesses_left);
+    if (allowed) {
+      key ^= allowed->key;
+    }
+    float cached;
+    bool exact;
+    if (cache->Lookup(key, cached, exact)) {
+      if (exact && cached < bound) {
+        if constexpr (kCollectStats) {
+          ++workspace.stats.cache_hits[num_guesses];
+        }
+        return cached;
+      }
+      if (cached >= bound) {
+        if constexpr (kCollectStats) {
+          ++workspace.stats.cache_hits[num_guesses];
+        }
+        return std::nullopt;
+      }
+    }
+  }
+  std::optional<float> min_expected;
+  int min_order;
+  // Guesses only need to beat the best guess so far.
+  double next_bound = bound;
+  ForEachGuess<Objective>(
+      search, num_guesses, workspace, words_left, num_words_left, weight,
+      [&](int guess, int order) {
+        std::optional<float> result = EvaluateGuess<Objective, kGuessesLeft>(
+            search, num_guesses, workspace, guess, words_left, num_words_left,
+            weight, next_bound);
+        if (result && (!min_expected || *result < *min_expected ||
+                       (*result == *min_expected && order < min_order))) {
+          min_expected = result;
+          min_order = order;
+          next_bound = std::min(next_bound, *result + kBoundSlack);
+        }
+        return next_bound;
+      });
+  if (cache && num_words_left >= kMinCachedWords) {
+    if (min_expected) {
+      cache->Insert(key, num_words_left, *min_expected, /*exact=*/true);
+    } else {
+      cache->Insert(key, num_words_left, bound, /*exact=*/false);
+    }
+  }
+  return min_expected;
+}
+
+// A guess and its value for the objective, e.g. the expected number of guesses
+// you need to make to win, including that guess.
+struct BestGuess {
+  int word;
+  float expected;
+};
+
+// Finds the guess with the smallest value for the objective, e.g. the one that
+// minimizes the expected number of guesses you need to make to win, once
+// num_guesses guesses have already been made and the given words are left. Ties
+// are broken in favor of the guess that comes first in the natural order of
+// ForEachGuess.
+//
+// Returns std::nullopt if it's not possible to always win.
+template <typename Objective>
+std::optional<BestGuess> FindBestGuess(const SearchContext& search,
+                                       int num_guesses, Workspace& workspace,
+                                       const int* words_left,
+                                       int num_words_left) {
+  std::optional<BestGuess> best;
+  int best_order;
+  double bound = std::numeric_limits<double>::infinity();
+  SetWeight weight = WeighWords(search.weights, words_left, num_words_left);
+  ForEachGuess<Objective>(
+      search, num_guesses, workspace, words_left, num_words_left, weight,
+      [&](int guess, int order) {
+        std::optional<float> result =
+            EvaluateGuess<Objective, kAnyGuessesLeft>(
+                search, num_guesses, workspace, guess, words_left,
+                num_words_left, weight, bound);
+        if (result && (!best || *result < best->expected ||
+                       (*result == best->expected && order < best_order))) {
+          best = BestGuess{guess, *result};
+          best_order = order;
+          bound = std::min(bound, *result + kBoundSlack);
+        }
+        return bound;
+      });
+  return best;
+}
+
+// Same as above, for the objective of the search.
+std::optional<BestGuess> FindBestGuess(const SearchContext& search,
+                                       int num_guesses, Workspace& workspace,
+                                       const int* words_left,
+                                       int num_words_left) {
+  return WithObjective(search, [&](auto objective) {
+    return FindBestGuess<decltype(objective)>(search, num_guesses, workspace,
+                                              words_left, num_words_left);
+  });
+}
+
+// Returns the given guesses already made joined into one string, with a space
+// after every guess and pattern.
+std::string JoinGuesses(const std::vector<std::string>& guesses) {
+  std::string joined;
+  for (const std::string& guess : guesses) {
+    joined += guess + " ";
+  }
+  return joined;
+}
+
+// A decision tree file holds the whole optimal strategy from a given position,
+// so every later turn is a lookup instead of a search. After the header, it
+// has the prefix: a uint32_t with the length of the guesses already made in the
+// position, followed by the guesses as given by JoinGuesses, padded to a
+// multiple of 4 bytes. Then it has the nodes, where the first node is the root.
+static constexpr char kDecisionTreeMagic[8] = "WRDLTRE";
+// Must be incremented whenever the file format changes.
+static constexpr uint32_t kDecisionTreeVersion = 2;
+
+// A node of the decision tree, followed by num_children TreeChild entries in
+// increasing pattern order, one for every possible pattern other than all
+// green.
+struct TreeNode {
+  // The guess to play.
+  uint16_t guess;
+  uint16_t num_children;
+  // Expected number of guesses you need to make to win, including the guess.
+  float expected;
+};
+struct TreeChild {
+  Pattern pattern;
+  uint8_t padding[4 - sizeof(Pattern)];
+  // Offset of the child node from the start of the root.
+  uint32_t offset;
+};
+
+// Appends the node for the given guess and all of its descendants to nodes, and
+// returns the offset of the node. The guess is played once num_guesses guesses
+// have already been made and the given words are left.
+//
+// Returns std::nullopt if some pattern of a guess can't be won within
+// max_num_guesses guesses, which never happens for optimal guesses.
+std::optional<uint32_t> AppendTreeNode(const SearchContext& search,
+                                       int num_guesses, Workspace& workspace,
+                                       const std::vector<int>& words_left,
+                                       const BestGuess& guess,
+                                       std::vector<uint8_t>& nodes) {
+  const PatternTable& table = *search.table;
+  PatternBuckets& buckets = workspace.all_buckets[num_guesses];
+  CountPatterns(table, search.weights, guess.word, words_left.data(),
+                words_left.size(), buckets);
+  PlaceWords(table, guess.word, words_left.data(), words_left.size(), buckets);
+  // Copies the buckets, since the storage is reused by the children.
+  std::vector<std::pair<int, std::vector<int>>> children;
+  for (int b = 0; b < buckets.num_buckets; ++b) {
+    if (buckets.patterns[b] != kAllGreen) {
+      children.emplace_back(
+          buckets.patterns[b],
+          std::vector<int>(&buckets.words[buckets.start[b]],
+                           &buckets.words[buckets.start[b + 1]]));
+    }
+  }
+
+  uint32_t offset = nodes.size();
+  nodes.resize(offset + sizeof(TreeNode) + children.size() * sizeof(TreeChild));
+  TreeNode node = {};
+  node.guess = guess.word;
+  node.num_children = children.size();
+  node.expected = guess.expected;
+  std::memcpy(&nodes[offset], &node, sizeof(node));
+  for (int c = 0; c < children.size(); ++c) {
+    const std::vector<int>& child_words = children[c].second;
+    if (search.hard_table) {
+      FilterAllowed(*search.hard_table, guess.word, children[c].first,
+                    workspace.all_allowed[num_guesses],
+                    workspace.all_allowed[num_guesses + 1]);
+    }
+    std::optional<BestGuess> best =
+        FindBestGuess(search, num_guesses + 1, workspace, child_words.data(),
+                      child_words.size());
+    if (!best) {
+      return std::nullopt;
+    }
+    std::optional<uint32_t> child_offset = AppendTreeNode(
+        search, num_guesses + 1, workspace, child_words, *best, nodes);
+    if (!child_offset) {
+      return std::nullopt;
+    }
+    TreeChild child = {};
+    child.pattern = children[c].first;
+    child.offset = *child_offset;
+    std::memcpy(&nodes[offset + sizeof(TreeNode) + c * sizeof(TreeChild)],
+                &child, sizeof(child));
+  }
+  return offset;
+}
+
+// Computes the decision tree from the position after the given guesses, where
+// the given words are left and root is the best guess, and saves it to the
+// given file. In hard mode, allowed are the guesses that are allowed in the
+// position.
+//
+// Returns false and sets error if the tree can't be computed.
+bool SaveDecisionTree(const std::string& filename,
+                      const std::vector<std::string>& guess_words,
+                      const std::vector<std::string>& words,
+                      const std::vector<std::string>& guesses,
+                      const SearchContext& search,
+                      const std::vector<int>& words_left,
+                      const AllowedGuesses& allowed, const BestGuess& root,
+                      std::string& error) {
+  // Nodes store guesses in 16 bits.
+  if (guess_words.size() > UINT16_MAX) {
+    error = "Too many guesses for a decision tree: " +
+            std::to_string(guess_words.size());
+    return false;
+  }
+  std::string prefix = JoinGuesses(guesses);
+  std::vector<uint8_t> data(sizeof(uint32_t) + (prefix.size() + 3) / 4 * 4);
+  uint32_t prefix_size = prefix.size();
+  std::memcpy(&data[0], &prefix_size, sizeof(prefix_size));
+  std::memcpy(&data[sizeof(prefix_size)], prefix.data(), prefix.size());
+
+  Workspace workspace(search.max_num_guesses, words_left.size(),
+                      search.table->num_guesses);
+  workspace.all_allowed[0] = allowed;
+  std::vector<uint8_t> nodes;
+  if (!AppendTreeNode(search, /*num_guesses=*/0, workspace, words_left, root,
+                      nodes)) {
+    error = "Some pattern of the decision tree can't be won";
+    return false;
+  }
+  data.insert(data.end(), nodes.begin(), nodes.end());
+  SaveFile(filename, kDecisionTreeMagic, kDecisionTreeVersion, guess_words,
+           words, data.data(), data.size());
+  return true;
+}
+
+// A decision tree loaded from a file.
+struct DecisionTree {
+  // The guesses already made in the position at the root.
+  std::string prefix;
+  // The nodes, which are kept alive by storage.
+  const uint8_t* nodes;
+  size_t size;
+  std::shared_ptr<const void> storage;
+};
+
+// Loads the decision tree for the given guesses and answers from the given
+// file.
+//
+// Returns std::nullopt if the file doesn't exist or doesn't match the words.
+std::optional<DecisionTree> LoadDecisionTree(
+    const std::string& filename, const std::vector<std::string>& guesses,
+    const std::vector<std::string>& answers) {
+  std::optional<MappedFile> file = MapFile(
+      filename, kDecisionTreeMagic, kDecisionTreeVersion, guesses, answers);
+  if (!file || file->size < sizeof(uint32_t)) {
+    return std::nullopt;
+  }
+  uint32_t prefix_size;
+  std::memcpy(&prefix_size, file->data, sizeof(prefix_size));
+  size_t nodes_start = sizeof(prefix_size) + (prefix_size + 3) / 4 * 4;
+  if (nodes_start + sizeof(TreeNode) > file->size) {
+    return std::nullopt;
+  }
+  DecisionTree tree;
+  tree.prefix.assign(
+      reinterpret_cast<const char*>(file->data) + sizeof(prefix_size),
+      prefix_size);
+  tree.nodes = file->data + nodes_start;
+  tree.size = file->size - nodes_start;
+  tree.storage = file->storage;
+  return tree;
+}
+
+// Reads the node at the given offset of the tree into node, and points children
+// at its children. The file may be corrupted, so the node and its children are
+// checked to lie in it before they are read, and its guess to be one of the
+// num_guesses guesses.
+//
+// Returns false if they don't.
+bool ReadTreeNode(const DecisionTree& tree, int num_guesses, uint32_t offset,
+                  TreeNode& node, const TreeChild*& children) {
+  if (offset % alignof(TreeNode) != 0 ||
+      uint64_t{offset} + sizeof(TreeNode) > tree.size) {
+    return false;
+  }
+  std::memcpy(&node, &tree.nodes[offset], sizeof(node));
+  if (uint64_t{offset} + sizeof(TreeNode) +
+              uint64_t{node.num_children} * sizeof(TreeChild) >
+          tree.size ||
+      node.guess >= num_guesses) {
+    return false;
+  }
+  children = reinterpret_cast<const TreeChild*>(
+      &tree.nodes[offset + sizeof(TreeNode)]);
+  return true;
+}
+
+// Returns the child of the given node for the given pattern, or nullptr if no
+// words are possible after it.
+const TreeChild* FindTreeChild(const TreeNode& node, const TreeChild* children,
+                               int pattern) {
+  const TreeChild* child = std::lower_bound(
+      children, children + node.num_children, pattern,
+      [](const TreeChild& child, int pattern) {
+        return child.pattern < pattern;
+      });
+  if (child == children + node.num_children || child->pattern != pattern) {
+    return nullptr;
+  }
+  return child;
+}
+
+// Finds the next guess to play after the given guesses already made by walking
+// the decision tree, without any search, and sets offset to the offset of its
+// node. Guesses are numbered as in guess_words.
+//
+// Returns false and sets error if the guesses don't follow the tree.
+bool LookupDecisionTree(const DecisionTree& tree,
+                        const std::vector<std::string>& guess_words,
+                        const std::vector<std::string>& guesses,
+                        BestGuess& next, uint32_t& offset,
+                        std::string& error) {
+  std::string joined = JoinGuesses(guesses);
+  if (joined.rfind(tree.prefix, 0) != 0) {
+    error = "The guesses don't start with the guesses of the tree: " +
+            tree.prefix;
+    return false;
+  }
+  std::istringstream sin(joined.substr(tree.prefix.size()));
+  offset = 0;
+  while (true) {
+    TreeNode node;
+    const TreeChild* children;
+    if (!ReadTreeNode(tree, guess_words.size(), offset, node, children)) {
+      error = "The tree is corrupted";
+      return false;
+    }
+    std::string guess;
+    std::string pattern;
+    if (!(sin >> guess)) {
+      next = BestGuess{node.guess, node.expected};
+      return true;
+    }
+    if (!(sin >> pattern)) {
+      error = "Every guess needs a pattern";
+      return false;
+    }
+    if (guess != guess_words[node.guess]) {
+      error = "The tree plays " + guess_words[node.guess] + ", not " + guess;
+      return false;
+    }
+    if (!IsValidPattern(pattern)) {
+      error = "Invalid pattern: " + pattern;
+      return false;
+    }
+    int pattern_int = ToPatternInt(pattern);
+    if (pattern_int == kAllGreen) {
+      if (sin >> guess) {
+        error = "The game is already won";
+        return false;
+      }
+      next = BestGuess{node.guess, 1};
+      return true;
+    }
+    const TreeChild* child = FindTreeChild(node, children, pattern_int);
+    if (!child) {
+      error = "No words are possible";
+      return false;
+    }
+    offset = child->offset;
+  }
+}
+
+// Plays the decision tree from the node at the given offset, where the given
+// words are left, for every one of the words as the answer, without any search.
+// Sets sequences[word] to the guesses played until the word is found, as
+// SimulateAll does for the search.
+//
+// Returns false and sets error if the tree is corrupted or doesn't cover the
+// words.
+bool SimulateDecisionTree(const DecisionTree& tree, const PatternTable& table,
+                          int num_guesses, uint32_t root,
+                          const std::vector<int>& words_left,
+                          std::vector<std::vector<int>>& sequences,
+                          std::string& error) {
+  for (int word : words_left) {
+    std::vector<int>& played = sequences[word];
+    played.clear();
+    uint32_t offset = root;
+    while (true) {
+      TreeNode node;
+      const TreeChild* children;
+      if (!ReadTreeNode(tree, num_guesses, offset, node, children)) {
+        error = "The tree is corrupted";
+        return false;
+      }
+      played.push_back(node.guess);
+      int pattern = table.Row(node.guess)[word];
+      if (pattern == kAllGreen) {
+        break;
+      }
+      const TreeChild* child = FindTreeChild(node, children, pattern);
+      if (!child) {
+        error = "The tree doesn't cover all the words left";
+        return false;
+      }
+      // Children always come after their parent, so a corrupted tree can't
+      // make this loop forever.
+      if (child->offset <= offset) {
+        error = "The tree is corrupted";
+        return false;
+      }
+      offset = child->offset;
+    }
+  }
+  return true;
+}
+
+// Pool of worker threads running tasks, with work stealing. Every worker has
+// its own queue of tasks. A worker runs the most recently added task of its own
+// queue first, and once its queue is empty, it steals the oldest task from the
+// queue of another worker. That way expensive tasks don't leave other workers
+// idle while cheap ones remain queued elsewhere.
+class ThreadPool {
+ public:
+  // Tasks are given the index of the worker running them, in range
+  // [0, num_workers).
+  using Task = std::function<void(int worker)>;
+
+  explicit ThreadPool(int num_workers)
+      : queues_(num_workers), pinned_(num_workers) {
+    for (int worker = 0; worker < num_workers; ++worker) {
+      threads_.emplace_back([this, worker]() { Run(worker); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> guard(mu_);
+      stop_ = true;
+    }
+    work_available_.notify_all();
+    for (std::thread& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  int num_workers() const { return queues_.size(); }
+
+  // Adds a task to the pool. Tasks added by a worker go to its own queue, and
+  // other tasks are spread over all the queues.
+  void Submit(Task task) {
+    int queue = current_worker_;
+    if (current_pool_ != this) {
+      queue = next_queue_.fetch_add(1, std::memory_order_relaxed) %
+              queues_.size();
+    }
+    num_pending_.fetch_add(1, std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> guard(queues_[queue].mu);
+      queues_[queue].tasks.push_back(std::move(task));
+    }
+    {
+      std::lock_guard<std::mutex> guard(mu_);
+      ++num_queued_;
+    }
+    work_available_.notify_one();
+  }
+
+  // Runs f(worker) once on every worker, on the thread of that worker, and
+  // blocks until all tasks are done. These tasks are never stolen.
+  void ForEachWorker(const std::function<void(int worker)>& f) {
+    num_pending_.fetch_add(queues_.size(), std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> guard(mu_);
+      for (std::deque<Task>& pinned : pinned_) {
+        pinned.push_back(f);
+      }
+    }
+    // Every worker has a task of its own to run, so all of them must wake up.
+    work_available_.notify_all();
+    Wait();
+  }
+
+  // Blocks until all tasks are done, including the tasks they added.
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mu_);
+    all_done_.wait(lock, [this]() {
+      return num_pending_.load(std::memory_order_acquire) == 0;
+    });
+  }
+
+ private:
+  struct Queue {
+    std::mutex mu;
+    std::deque<Task> tasks;
+  };
+
+  void Run(int worker) {
+    current_pool_ = this;
+    current_worker_ = worker;
+    while (true) {
+      Task task;
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        work_available_.wait(lock, [this, worker]() {
+          return stop_ || num_queued_ > 0 || !pinned_[worker].empty();
+        });
+        if (stop_) {
+          return;
+        }
+        if (!pinned_[worker].empty()) {
+          task = std::move(pinned_[worker].front());
+          pinned_[worker].pop_front();
+        }
+      }
+      if (!task && !Pop(worker, task)) {
+        continue;
+      }
+      task(worker);
+      if (num_pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> guard(mu_);
+        all_done_.notify_all();
+      }
+    }
+  }
+
+  // Takes a task from the back of the worker's own queue, or else from the
+  // front of the queue of another worker.
+  bool Pop(int worker, Task& task) {
+    for (int i = 0; i < queues_.size(); ++i) {
+      Queue& queue = queues_[(worker + i) % queues_.size()];
+      std::lock_guard<std::mutex> guard(queue.mu);
+      if (queue.tasks.empty()) {
+        continue;
+      } else if (i == 0) {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      } else {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      }
+      std::lock_guard<std::mutex> queued_guard(mu_);
+      --num_queued_;
+      return true;
+    }
+    return false;
+  }
+
+  std::vector<Queue> queues_;
+  std::vector<std::thread> threads_;
+  std::atomic<int> next_queue_{0};
+  // Number of tasks submitted but not yet done.
+  std::atomic<int> num_pending_{0};
+
+  // Guards num_queued_, pinned_ and stop_.
+  std::mutex mu_;
+  // Number of tasks in all the queues.
+  int num_queued_ = 0;
+  // Tasks that only the given worker runs, see ForEachWorker. They aren't
+  // counted in num_queued_, so they never wake up the other workers.
+  std::vector<std::deque<Task>> pinned_;
+  bool stop_ = false;
+  std::condition_variable work_available_;
+  std::condition_variable all_done_;
+
+  static thread_local ThreadPool* current_pool_;
+  static thread_local int current_worker_;
+};
+
+thread_local ThreadPool* ThreadPool::current_pool_ = nullptr;
+thread_local int ThreadPool::current_worker_ = 0;
+
+// Returns a Workspace for every worker of the given pool, each one created by
+// its own worker, so its memory is first touched on the NUMA node the worker
+// runs on. In hard mode, every workspace starts with the given allowed
+// guesses.
+std::vector<std::unique_ptr<Workspace>> CreateWorkspaces(
+    ThreadPool& pool, int max_num_guesses, int num_words, int num_guesses,
+    const AllowedGuesses& allowed = AllowedGuesses()) {
+  std::vector<std::unique_ptr<Workspace>> workspaces(pool.num_workers());
+  pool.ForEachWorker([&](int worker) {
+    workspaces[worker].reset(
+        new Workspace(max_num_guesses, num_words, num_guesses));
+    workspaces[worker]->all_allowed[0] = allowed;
+  });
+  return workspaces;
+}
+
+// A first word that is done, with the expected number of guesses if it has
+// one. First words without any are either not possible to always win with or
+// were cut off.
+struct FirstWordResult {
+  int first_word;
+  std::optional<float> expected;
+  // The next result in the list of results not yet written.
+  FirstWordResult* next;
+};
+
+// Packs the given result of a first word into 64 bits, so comparing packed
+// results compares the expected values and then the words. The bits of
+// non-negative floats are in the same order as the floats.
+uint64_t PackBest(int first_word, float expected) {
+  uint32_t bits;
+  std::memcpy(&bits, &expected, sizeof(bits));
+  return static_cast<uint64_t>(bits) << 32 | static_cast<uint32_t>(first_word);
+}
+
+// The packed result of no first word, which is worse than any other.
+static constexpr uint64_t kNoBest = std::numeric_limits<uint64_t>::max();
+
+// Returns the result packed by PackBest, which must not be kNoBest.
+BestGuess UnpackBest(uint64_t packed) {
+  uint32_t bits = packed >> 32;
+  float expected;
+  std::memcpy(&expected, &bits, sizeof(expected));
+  return BestGuess{static_cast<int>(packed & 0xffffffff), expected};
+}
+
+// State shared by all the tasks that try first guesses.
+//
+// Workers never wait for each other to save their results. The best result is
+// updated with a compare and swap, and the results are pushed onto a lock-free
+// list. A single ResultWriter takes the whole list at a time and writes it in
+// one batch.
+struct Sweep {
+  SearchContext search;
+  // The names of all guesses.
+  const std::vector<std::string>* guess_words;
+  // If not null, first guesses are cut off as soon as they can't beat
+  // best_bound, which holds the best expected value found so far. Such first
+  // guesses are not saved in the results.
+  std::atomic<float>* best_bound;
+  // The words that are still possible, in order, and their weight.
+  std::vector<int> words_left;
+  SetWeight words_left_weight;
+  // In hard mode, the guesses that can't be the answer but are allowed as the
+  // first guess. Every workspace starts with them.
+  AllowedGuesses allowed;
+  // Storage space for each worker of the pool.
+  std::vector<std::unique_ptr<Workspace>> workspaces;
+
+  // The best first word so far, packed by PackBest, or kNoBest.
+  std::atomic<uint64_t> best{kNoBest};
+  // Number of first words done.
+  std::atomic<int> num_finished{0};
+  // The first words done that ResultWriter hasn't written yet, most recent
+  // first.
+  std::atomic<FirstWordResult*> unwritten{nullptr};
+  // Seconds that every first word took, or 0 if it wasn't tried. Only saved if
+  // kCollectStats is true.
+  std::vector<double> first_word_seconds;
+
+  // Only used by ResultWriter, and by the main thread before and after it
+  // runs.
+  //
+  // If open, every result is appended to it as soon as it's written, in CSV
+  // format. See SaveResult.
+  std::ofstream fout;
+  // The best num_top results so far, as (expected, first word). It's a heap
+  // with the worst of them first.
+  std::vector<std::pair<float, int>> results;
+  int num_top = 0;
+  // If open, every first word is appended to it once it's done. See
+  // LoadCheckpoint.
+  std::ofstream checkpoint;
+  // If set, called for every first word once it's done.
+  std::function<void(int first_word, std::optional<float> result)> on_finish;
+  // If not empty, the cache is saved to this file every kCacheSaveInterval, so
+  // a resumed sweep doesn't need to recompute it. The file is for the guesses
+  // guess_words and the answers answers.
+  std::string cache_file;
+  const std::vector<std::string>* answers;
+  std::chrono::steady_clock::time_point cache_saved_time;
+};
+
+// How often the cache is saved to the cache file of a sweep.
+static constexpr std::chrono::minutes kCacheSaveInterval(10);
+
+// Returns the bound that a first guess has to beat.
+double FirstWordBound(const Sweep& sweep) {
+  if (!sweep.best_bound) {
+    return std::numeric_limits<double>::infinity();
+  }
+  return sweep.best_bound->load(std::memory_order_relaxed) + kBoundSlack;
+}
+
+// Lowers the bound of the given sweep to bound, unless it's already lower,
+// which happens if it was found by another worker or another node.
+void LowerBestBound(Sweep& sweep, float bound) {
+  if (!sweep.best_bound) {
+    return;
+  }
+  float current = sweep.best_bound->load(std::memory_order_relaxed);
+  while (bound < current && !sweep.best_bound->compare_exchange_weak(
+                                current, bound, std::memory_order_relaxed)) {
+  }
+}
+
+// Saves the given result as the best first word, if it's better than the best
+// one so far.
+void SaveBest(Sweep& sweep, int first_word, float result) {
+  uint64_t packed = PackBest(first_word, result);
+  uint64_t current = sweep.best.load(std::memory_order_relaxed);
+  while (packed < current && !sweep.best.compare_exchange_weak(
+                                 current, packed, std::memory_order_relaxed)) {
+  }
+  LowerBestBound(sweep, result);
+}
+
+// Returns the best first word and its expected number of guesses, or
+// std::nullopt if no first word has a result yet.
+std::optional<BestGuess> LoadBest(const Sweep& sweep) {
+  uint64_t packed = sweep.best.load(std::memory_order_relaxed);
+  if (packed == kNoBest) {
+    return std::nullopt;
+  }
+  return UnpackBest(packed);
+}
+
+// Saves the expected number of guesses for the given first word in the
+// results, without flushing the results file. The file has a line
+// "<word>,<expected>" for every result, in the order they were done, with the
+// full precision of the expected value, so the file never needs to be sorted
+// or rewritten. Only the best num_top results are kept in memory.
+void SaveResult(Sweep& sweep, int first_word, float result) {
+  if (sweep.fout.is_open()) {
+    sweep.fout << (*sweep.guess_words)[first_word] << ","
+               << std::setprecision(std::numeric_limits<float>::max_digits10)
+               << result << "\n";
+  }
+  if (sweep.num_top > 0) {
+    sweep.results.emplace_back(result, first_word);
+    std::push_heap(sweep.results.begin(), sweep.results.end());
+    if (sweep.results.size() > sweep.num_top) {
+      std::pop_heap(sweep.results.begin(), sweep.results.end());
+      sweep.results.pop_back();
+    }
+  }
+}
+
+// Appends the given first word to the checkpoint file, with its full precision
+// result, or "-" if it has none, without flushing the file.
+void SaveCheckpoint(Sweep& sweep, int first_word, std::optional<float> result) {
+  sweep.checkpoint << (*sweep.guess_words)[first_word] << " ";
+  if (result) {
+    sweep.checkpoint << std::setprecision(
+                            std::numeric_limits<float>::max_digits10)
+                     << *result << "\n";
+  } else {
+    sweep.checkpoint << "-\n";
+  }
+}
+
+// Records that the given first word is done, with the expected number of
+// guesses if it has one. The result is written later by the ResultWriter.
+void FinishFirstWord(Sweep& sweep, int first_word,
+                     std::optional<float> result) {
+  if (result) {
+    SaveBest(sweep, first_word, *result);
+  }
+  FirstWordResult* node = new FirstWordResult{first_word, result, nullptr};
+  node->next = sweep.unwritten.load(std::memory_order_relaxed);
+  while (!sweep.unwritten.compare_exchange_weak(node->next, node,
+                                                std::memory_order_release,
+                                                std::memory_order_relaxed)) {
+  }
+  sweep.num_finished.fetch_add(1, std::memory_order_relaxed);
+}
+
+// How often ResultWriter writes the results of a sweep.
+static constexpr std::chrono::milliseconds kResultWriteInterval(100);
+
+// Writes the results of a sweep in batches on a separate thread while it's
+// alive, and once more when it's destroyed. Every batch is written to the
+// results file, the checkpoint and on_finish in the order the first words were
+// done, and then the files are flushed once. The cache file is saved here too,
+// so no worker has to stop for it.
+class ResultWriter {
+ public:
+  explicit ResultWriter(Sweep& sweep)
+      : sweep_(sweep), thread_([this]() { Run(); }) {}
+
+  ~ResultWriter() {
+    {
+      std::lock_guard<std::mutex> guard(mu_);
+      stop_ = true;
+    }
+    stopped_.notify_all();
+    thread_.join();
+    WriteBatch();
+  }
+
+ private:
+  void Run() {
+    std::unique_lock<std::mutex> lock(mu_);
+    while (!stopped_.wait_for(lock, kResultWriteInterval,
+                              [this]() { return stop_; })) {
+      WriteBatch();
+      if (!sweep_.cache_file.empty() &&
+          std::chrono::steady_clock::now() - sweep_.cache_saved_time >=
+              kCacheSaveInterval) {
+        sweep_.search.cache->Save(sweep_.cache_file, *sweep_.guess_words,
+                                  *sweep_.answers);
+        sweep_.cache_saved_time = std::chrono::steady_clock::now();
+      }
+    }
+  }
+
+  void WriteBatch() {
+    FirstWordResult* node =
+        sweep_.unwritten.exchange(nullptr, std::memory_order_acquire);
+    // The list is most recent first.
+    FirstWordResult* reversed = nullptr;
+    while (node) {
+      FirstWordResult* next = node->next;
+      node->next = reversed;
+      reversed = node;
+      node = next;
+    }
+    if (!reversed) {
+      return;
+    }
+    for (node = reversed; node;) {
+      if (node->expected) {
+        SaveResult(sweep_, node->first_word, *node->expected);
+      }
+      if (sweep_.checkpoint.is_open()) {
+        SaveCheckpoint(sweep_, node->first_word, node->expected);
+      }
+      if (sweep_.on_finish) {
+        sweep_.on_finish(node->first_word, node->expected);
+      }
+      FirstWordResult* next = node->next;
+      delete node;
+      node = next;
+    }
+    sweep_.fout.flush();
+    sweep_.checkpoint.flush();
+  }
+
+  Sweep& sweep_;
+  std::mutex mu_;
+  std::condition_variable stopped_;
+  bool stop_ = false;
+  // Must be last, so everything else is initialized before it runs.
+  std::thread thread_;
+};
+
+// Writes the results of the given sweep kept by SaveResult to out, in
+// increasing order of expected value and then of the word index.
+void WriteResults(const Sweep& sweep, std::ostream& out) {
+  std::vector<std::pair<float, int>> results = sweep.results;
+  std::sort(results.begin(), results.end());
+  for (const std::pair<float, int>& result : results) {
+    out << (*sweep.guess_words)[result.second] << " "
+        << std::setprecision(std::numeric_limits<float>::max_digits10)
+        << result.first << "\n";
+  }
+}
+
+// Saves how long the given first word took, since start, if kCollectStats is
+// true. Must be called before the first word is finished.
+void SaveFirstWordTime(Sweep& sweep, int first_word,
+                       std::chrono::steady_clock::time_point start) {
+  if constexpr (kCollectStats) {
+    sweep.first_word_seconds[first_word] =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+            .count();
+  }
+}
+
+// Tries the given first guess.
+void TryFirstWord(Sweep& sweep, int worker, int first_word) {
+  auto start = std::chrono::steady_clock::now();
+  std::optional<float> result =
+      WithObjective(sweep.search, [&](auto objective) {
+        return EvaluateGuess<decltype(objective), kAnyGuessesLeft>(
+            sweep.search, /*num_guesses=*/0, *sweep.workspaces[worker],
+            first_word, sweep.words_left.data(), sweep.words_left.size(),
+            sweep.words_left_weight, FirstWordBound(sweep));
+      });
+  SaveFirstWordTime(sweep, first_word, start);
+  FinishFirstWord(sweep, first_word, result);
+}
+
+// Returns the given number of seconds as a duration like "1h 02m 03s".
+std::string FormatDuration(double seconds) {
+  int64_t total = seconds;
+  std::ostringstream sout;
+  sout << std::setfill('0');
+  if (total >= 3600) {
+    sout << total / 3600 << "h " << std::setw(2) << total / 60 % 60 << "m "
+         << std::setw(2);
+  } else if (total >= 60) {
+    sout << total / 60 << "m " << std::setw(2);
+  }
+  sout << total % 60 << "s";
+  return sout.str();
+}
+
+// Reports the progress of a sweep to stderr at a fixed interval while it's
+// alive: the number of first words done, nodes per second over the last
+// interval, the best first word so far and the estimated time left. It only
+// reads atomics, so the workers never wait for it.
+class ProgressReporter {
+ public:
+  // num_first_words is the number of first words the sweep has to try.
+  ProgressReporter(const Sweep& sweep, int num_first_words,
+                   std::chrono::seconds interval)
+      : sweep_(sweep),
+        num_first_words_(num_first_words),
+        interval_(interval),
+        thread_([this]() { Run(); }) {}
+
+  ~ProgressReporter() {
+    {
+      std::lock_guard<std::mutex> guard(mu_);
+      stop_ = true;
+    }
+    stopped_.notify_all();
+    thread_.join();
+  }
+
+ private:
+  int64_t NumNodes() const {
+    int64_t num_nodes = 0;
+    for (const std::unique_ptr<Workspace>& workspace : sweep_.workspaces) {
+      num_nodes += workspace->num_nodes.load(std::memory_order_relaxed);
+    }
+    return num_nodes;
+  }
+
+  void Run() {
+    auto start = std::chrono::steady_clock::now();
+    auto last = start;
+    int64_t last_num_nodes = NumNodes();
+    std::unique_lock<std::mutex> lock(mu_);
+    while (!stopped_.wait_for(lock, interval_, [this]() { return stop_; })) {
+      auto now = std::chrono::steady_clock::now();
+      int64_t num_nodes = NumNodes();
+      int num_finished = sweep_.num_finished.load(std::memory_order_relaxed);
+      double elapsed = std::chrono::duration<double>(now - start).count();
+      double nodes_per_second =
+          (num_nodes - last_num_nodes) /
+          std::chrono::duration<double>(now - last).count();
+      last = now;
+      last_num_nodes = num_nodes;
+
+      std::ostringstream sout;
+      sout << "Progress: " << num_finished << "/" << num_first_words_
+           << " first words, " << static_cast<int64_t>(nodes_per_second)
+           << " nodes/s";
+      std::optional<BestGuess> best = LoadBest(sweep_);
+      if (best) {
+        sout << ", best so far: " << (*sweep_.guess_words)[best->word] << " "
+             << best->expected;
+      }
+      // Assumes the first words left take as long as the ones done on
+      // average.
+      if (num_finished > 0) {
+        sout << ", elapsed " << FormatDuration(elapsed) << ", ETA "
+             << FormatDuration(elapsed / num_finished *
+                               (num_first_words_ - num_finished));
+      }
+      std::cerr << sout.str() << std::endl;
+    }
+  }
+
+  const Sweep& sweep_;
+  int num_first_words_;
+  std::chrono::seconds interval_;
+  std::mutex mu_;
+  std::condition_variable stopped_;
+  bool stop_ = false;
+  // Must be last, so everything else is initialized before it runs.
+  std::thread thread_;
+};
+
+// A first guess whose patterns are computed by separate tasks.
+struct SplitFirstWord {
+  int first_word;
+  std::chrono::steady_clock::time_point start_time;
+  double bound_sum;
+  // Copy of the buckets of the words left after the first guess.
+  std::vector<int> words;
+  std::vector<int> start;
+  std::vector<Pattern> patterns;
+  std::vector<SetWeight> weights;
+  // expected[b] is the value of bucket b, e.g. the expected number of guesses
+  // including the first guess.
+  std::vector<float> expected;
+  // Same as lower_sum in EvaluateGuess, updated as buckets are done. Unused for
+  // worst case objectives.
+  std::atomic<double> lower_sum;
+  // Set once any bucket can't beat its bound.
+  std::atomic<bool> abandoned{false};
+  std::atomic<int> num_buckets_left;
+};
+
+// Computes bucket b of the given first guess, and saves the result of the first
+// guess if it was the last bucket left.
+template <typename Objective>
+void TryFirstWordBucket(Sweep& sweep, int worker, SplitFirstWord& split,
+                        int b) {
+  const int* new_words_left = &split.words[split.start[b]];
+  int new_num_words_left = split.start[b + 1] - split.start[b];
+  SetWeight new_weight = split.weights[b];
+  if (split.abandoned.load(std::memory_order_relaxed)) {
+    // Nothing to do.
+  } else if (new_words_left[0] == split.first_word) {
+    // Correct guess.
+    split.expected[b] = Objective::kGuessValue;
+  } else {
+    int num_guesses_left = sweep.search.max_num_guesses - 1;
+    double lower = 0;
+    double lower_sum = 0;
+    double new_bound;
+    if constexpr (Objective::kWorstCase) {
+      new_bound = split.bound_sum - Objective::kGuessValue;
+    } else {
+      lower = new_weight.total *
+              (Objective::kGuessValue +
+               Objective::LowerBound(new_num_words_left, new_weight,
+                                     num_guesses_left));
+      lower_sum = split.lower_sum.load(std::memory_order_relaxed);
+      new_bound = (split.bound_sum - (lower_sum - lower)) / new_weight.total -
+                  Objective::kGuessValue;
+    }
+    if (sweep.search.hard_table && new_num_words_left > 2) {
+      FilterAllowed(*sweep.search.hard_table, split.first_word,
+                    split.patterns[b], sweep.allowed,
+                    sweep.workspaces[worker]->all_allowed[1]);
+    }
+    std::optional<float> next_result = RecurseWithGuessesLeft<Objective>(
+        sweep.search, /*num_guesses=*/1, *sweep.workspaces[worker],
+        new_words_left, new_num_words_left, new_weight, new_bound);
+    if (!next_result) {
+      split.abandoned.store(true, std::memory_order_relaxed);
+    } else {
+      split.expected[b] = Objective::kGuessValue + *next_result;
+      if constexpr (!Objective::kWorstCase) {
+        double delta = new_weight.total * split.expected[b] - lower;
+        while (!split.lower_sum.compare_exchange_weak(lower_sum,
+                                                      lower_sum + delta)) {
+        }
+      }
+    }
+  }
+  if (split.num_buckets_left.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+  std::optional<float> result;
+  if (!split.abandoned.load(std::memory_order_relaxed)) {
+    // Sums up the buckets in order, so the result is exactly the same as the
+    // result of EvaluateGuess.
+    float sum = 0;
+    for (int b = 0; b < split.weights.size(); ++b) {
+      if constexpr (Objective::kWorstCase) {
+        sum = std::max(sum, split.expected[b]);
+      } else {
+        sum += split.weights[b].total * split.expected[b];
+      }
+    }
+    double bound = split.bound_sum;
+    if constexpr (!Objective::kWorstCase) {
+      float total = sweep.words_left_weight.total;
+      sum /= total;
+      bound /= total;
+    }
+    if (sum < bound) {
+      result = sum;
+    }
+  }
+  SaveFirstWordTime(sweep, split.first_word, split.start_time);
+  FinishFirstWord(sweep, split.first_word, result);
+}
+
+// Tries the given first guess, where every pattern is computed by a separate
+// task in the pool.
+template <typename Objective>
+void SplitAndTryFirstWord(Sweep& sweep, ThreadPool& pool, int worker,
+                          int first_word) {
+  auto start = std::chrono::steady_clock::now();
+  PatternBuckets& buckets = sweep.workspaces[worker]->all_buckets[0];
+  const PatternTable& table = *sweep.search.table;
+  CountPatterns(table, sweep.search.weights, first_word,
+                sweep.words_left.data(), sweep.words_left.size(), buckets);
+  if (buckets.num_buckets == 1 && buckets.patterns[0] != kAllGreen) {
+    // The guess doesn't tell any of the words apart.
+    SaveFirstWordTime(sweep, first_word, start);
+    FinishFirstWord(sweep, first_word, std::nullopt);
+    return;
+  }
+  double bound_sum =
+      BoundSum<Objective>(FirstWordBound(sweep), sweep.words_left_weight);
+  int num_guesses_left = sweep.search.max_num_guesses - 1;
+  double lower_sum = 0;
+  for (int b = 0; b < buckets.num_buckets; ++b) {
+    SetWeight bucket_weight = buckets.weight[b];
+    if (buckets.patterns[b] == kAllGreen) {
+      AddBucket<Objective>(lower_sum, bucket_weight, Objective::kGuessValue);
+    } else {
+      AddBucket<Objective>(lower_sum, bucket_weight,
+                           Objective::kGuessValue +
+                               Objective::LowerBound(buckets.size(b),
+                                                     bucket_weight,
+                                                     num_guesses_left));
+    }
+  }
+  if (lower_sum >= bound_sum) {
+    SaveFirstWordTime(sweep, first_word, start);
+    FinishFirstWord(sweep, first_word, std::nullopt);
+    return;
+  }
+  PlaceWords(table, first_word, sweep.words_left.data(),
+             sweep.words_left.size(), buckets);
+  auto split = std::make_shared<SplitFirstWord>();
+  split->first_word = first_word;
+  split->start_time = start;
+  split->bound_sum = bound_sum;
+  split->words.assign(buckets.words,
+                      buckets.words + sweep.words_left.size());
+  split->start.assign(buckets.start, buckets.start + buckets.num_buckets + 1);
+  split->patterns.assign(buckets.patterns,
+                         buckets.patterns + buckets.num_buckets);
+  split->weights.assign(buckets.weight, buckets.weight + buckets.num_buckets);
+  split->expected.resize(buckets.num_buckets);
+  split->lower_sum = lower_sum;
+  split->num_buckets_left = buckets.num_buckets;
+  for (int b = 0; b < buckets.num_buckets; ++b) {
+    pool.Submit([&sweep, split, b](int worker) {
+      TryFirstWordBucket<Objective>(sweep, worker, *split, b);
+    });
+  }
+}
+
+// Same as above, for the objective of the sweep.
+void SplitAndTryFirstWord(Sweep& sweep, ThreadPool& pool, int worker,
+                          int first_word) {
+  WithObjective(sweep.search, [&](auto objective) {
+    SplitAndTryFirstWord<decltype(objective)>(sweep, pool, worker, first_word);
+  });
+}
+
+// The words left of several boards played at once, as in Quordle and
+// Octordle. Every board has its own answer, and every guess is played on all
+// the boards that are not solved yet. The words left of all the boards are
+// stored one after the other, so a guess is partitioned on all of them in a
+// single pass over its pattern row.
+struct Boards {
+  // The words left of board i are words[start[i]] to words[start[i + 1] - 1].
+  // Boards that are already solved have no words left.
+  std::vector<int> words;
+  std::vector<int> start;
+
+  int num_boards() const { return start.size() - 1; }
+  int size(int i) const { return start[i + 1] - start[i]; }
+};
+
+// Applies the given guesses already made on num_boards boards. Every guess is
+// followed by its pattern in string format on every board, in order, or "-" for
+// the boards that were already solved before the guess.
+//
+// Returns false and sets error if the guesses are not valid.
+bool ApplyBoardGuesses(const std::vector<std::string>& guess_words,
+                       const PatternTable& table, int num_boards,
+                       const std::vector<std::string>& guesses, Boards& boards,
+                       std::string& error) {
+  if (guesses.size() % (num_boards + 1) != 0) {
+    error = "Every guess needs a pattern for every board";
+    return false;
+  }
+  std::vector<int> all_words(table.num_answers);
+  for (int word = 0; word < table.num_answers; ++word) {
+    all_words[word] = word;
+  }
+  std::vector<std::vector<int>> words_left(num_boards, all_words);
+  std::vector<bool> solved(num_boards);
+  for (int guess_i = 0; guess_i < guesses.size(); guess_i += num_boards + 1) {
+    const std::string& guess = guesses[guess_i];
+    int word_i = std::find(guess_words.begin(), guess_words.end(), guess) -
+                 guess_words.begin();
+    if (word_i == guess_words.size()) {
+      error = "Unknown word: " + guess;
+      return false;
+    }
+    for (int i = 0; i < num_boards; ++i) {
+      const std::string& pattern = guesses[guess_i + 1 + i];
+      if (solved[i] != (pattern == "-")) {
+        error = "Invalid pattern: " + pattern +
+                ". Only boards already solved have no pattern";
+        return false;
+      }
+      if (solved[i]) {
+        continue;
+      }
+      if (!IsValidPattern(pattern)) {
+        error = "Invalid pattern: " + pattern;
+        return false;
+      }
+      int pattern_int = ToPatternInt(pattern);
+      words_left[i] = FilterWords(table, words_left[i], word_i, pattern_int);
+      if (words_left[i].empty()) {
+        error = "No words are possible on board " + std::to_string(i + 1);
+        return false;
+      }
+      solved[i] = pattern_int == kAllGreen;
+    }
+  }
+  boards.words.clear();
+  boards.start.assign(1, 0);
+  for (int i = 0; i < num_boards; ++i) {
+    if (!solved[i]) {
+      boards.words.insert(boards.words.end(), words_left[i].begin(),
+                          words_left[i].end());
+    }
+    boards.start.push_back(boards.words.size());
+  }
+  return true;
+}
+
+// Same as PatternBuckets, for the words left of all the boards after a guess.
+// There is one bucket for every board and pattern with at least one matching
+// word, keyed by board * kNumPatterns + pattern.
+struct BoardBuckets {
+  BoardBuckets(int num_boards, int num_words)
+      : keys(num_boards * kNumPatterns),
+        start(num_boards * kNumPatterns + 1),
+        weight(num_boards * kNumPatterns),
+        count(num_boards * kNumPatterns),
+        key_weight(num_boards * kNumPatterns),
+        words(num_words) {}
+
+  int num_buckets = 0;
+  // The words of bucket b are words[start[b]] to words[start[b + 1] - 1], and
+  // all of them are on the board and match the pattern of keys[b]. Buckets are
+  // in increasing key order, so the buckets of every board are next to each
+  // other.
+  std::vector<int> keys;
+  std::vector<int> start;
+  std::vector<SetWeight> weight;
+  // Scratch space for the partitioning, indexed by key. It is all zeros between
+  // calls to CountBoardPatterns and PlaceBoardWords.
+  std::vector<int> count;
+  std::vector<SetWeight> key_weight;
+  std::vector<int> words;
+
+  int size(int b) const { return start[b + 1] - start[b]; }
+};
+
+// Same as CountPatterns, for the words left of all the given boards, in one
+// pass over the pattern row of guess.
+void CountBoardPatterns(const PatternTable& table, const float* weights,
+                        int guess, const Boards& boards,
+                        BoardBuckets& buckets) {
+  const Pattern* row = table.Row(guess);
+  int* count = buckets.count.data();
+  int* keys = buckets.keys.data();
+  SetWeight* key_weight = buckets.key_weight.data();
+  int num_buckets = 0;
+  for (int i = 0; i < boards.num_boards(); ++i) {
+    int board_key = i * kNumPatterns;
+    for (int w = boards.start[i]; w < boards.start[i + 1]; ++w) {
+      int word = boards.words[w];
+      int key = board_key + row[word];
+      if (count[key]++ == 0) {
+        keys[num_buckets++] = key;
+      }
+      if (weights) {
+        key_weight[key].total += weights[word];
+        key_weight[key].max = std::max(key_weight[key].max, weights[word]);
+      }
+    }
+  }
+  std::sort(keys, keys + num_buckets);
+  int offset = 0;
+  for (int b = 0; b < num_buckets; ++b) {
+    int key = keys[b];
+    buckets.start[b] = offset;
+    offset += count[key];
+    if (!weights) {
+      buckets.weight[b] = SetWeight{static_cast<float>(count[key]), 1};
+    } else {
+      buckets.weight[b] = key_weight[key];
+      key_weight[key] = SetWeight{0, 0};
+    }
+    count[key] = 0;
+  }
+  buckets.start[num_buckets] = offset;
+  buckets.num_buckets = num_buckets;
+}
+
+// Same as PlaceWords, for the buckets computed by CountBoardPatterns.
+void PlaceBoardWords(const PatternTable& table, int guess, const Boards& boards,
+                     BoardBuckets& buckets) {
+  const Pattern* row = table.Row(guess);
+  int* count = buckets.count.data();
+  for (int b = 0; b < buckets.num_buckets; ++b) {
+    count[buckets.keys[b]] = buckets.start[b];
+  }
+  int* out = buckets.words.data();
+  for (int i = 0; i < boards.num_boards(); ++i) {
+    int board_key = i * kNumPatterns;
+    for (int w = boards.start[i]; w < boards.start[i + 1]; ++w) {
+      int word = boards.words[w];
+      out[count[board_key + row[word]]++] = word;
+    }
+  }
+  for (int b = 0; b < buckets.num_buckets; ++b) {
+    count[buckets.keys[b]] = 0;
+  }
+}
+
+// Returns the weight of bucket b of the given buckets for AddBucket, relative
+// to the weight of its board, so the values of the buckets of every board add
+// up to the value of the board.
+SetWeight BoardBucketWeight(const BoardBuckets& buckets, int b,
+                            const std::vector<SetWeight>& board_weights) {
+  float board_total = board_weights[buckets.keys[b] / kNumPatterns].total;
+  return SetWeight{buckets.weight[b].total / board_total,
+                   buckets.weight[b].max / board_total};
+}
+
+// Returns the lower bound of EvaluateBoardsGuess on the value of guess for the
+// buckets counted by CountBoardPatterns.
+template <typename Objective>
+double BoardsLowerSum(const BoardBuckets& buckets,
+                      const std::vector<SetWeight>& board_weights,
+                      int num_guesses_left) {
+  double lower_sum = 0;
+  for (int b = 0; b < buckets.num_buckets; ++b) {
+    SetWeight weight = BoardBucketWeight(buckets, b, board_weights);
+    if (buckets.keys[b] % kNumPatterns == kAllGreen) {
+      AddBucket<Objective>(lower_sum, weight, Objective::kGuessValue);
+    } else {
+      AddBucket<Objective>(lower_sum, weight,
+                           Objective::kGuessValue +
+                               Objective::LowerBound(buckets.size(b),
+                                                     buckets.weight[b],
+                                                     num_guesses_left));
+    }
+  }
+  return lower_sum;
+}
+
+// Returns a lower bound on the number of guesses needed to solve all the boards
+// that are not solved yet, if guess has just been played, or -1 if no guess
+// has. Boards whose words left are disjoint can't be solved by the same guess,
+// since the last guess of every board is its answer, so the bound is the size
+// of a set of such boards, picked greedily from the smallest board up. The
+// words left after guess are subsets of the words left before it, so boards
+// that are disjoint before it stay disjoint, whatever its patterns are.
+int DisjointBoards(const Boards& boards, int num_answers, int guess) {
+  std::vector<int> order;
+  for (int i = 0; i < boards.num_boards(); ++i) {
+    if (boards.size(i) > 1 ||
+        (boards.size(i) == 1 && boards.words[boards.start[i]] != guess)) {
+      order.push_back(i);
+    }
+  }
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    return boards.size(a) < boards.size(b);
+  });
+  std::vector<bool> taken(num_answers);
+  int num_disjoint = 0;
+  for (int i : order) {
+    bool disjoint = true;
+    for (int w = boards.start[i]; w < boards.start[i + 1] && disjoint; ++w) {
+      disjoint = boards.words[w] == guess || !taken[boards.words[w]];
+    }
+    if (!disjoint) {
+      continue;
+    }
+    for (int w = boards.start[i]; w < boards.start[i + 1]; ++w) {
+      taken[boards.words[w]] = true;
+    }
+    ++num_disjoint;
+  }
+  return num_disjoint;
+}
+
+// Same as EvaluateGuess, for the given boards, which weigh board_weights. This
+// is a heuristic: every board is then played on its own, as if it had all the
+// guesses left to itself and the guesses made for it didn't help the other
+// boards, and the expected numbers of guesses of all the boards, including
+// guess, are added up. The guesses the boards share are only accounted for by
+// DisjointBoards, which cuts off the guesses after which the boards certainly
+// need more guesses than are left. Optimal play of all the boards at once is
+// out of reach, but every board is played optimally on its own. Only the
+// expected number of guesses is supported, since the worst case and the win
+// rate of the boards depend on how they share the guesses.
+//
+// All the boards share the cache of the search, because their sets of words
+// left often end up the same, e.g. every board starts with all the words.
+template <typename Objective>
+std::optional<float> EvaluateBoardsGuess(
+    const SearchContext& search, int num_guesses, Workspace& workspace,
+    BoardBuckets& buckets, int guess, const Boards& boards,
+    const std::vector<SetWeight>& board_weights, double bound) {
+  static_assert(std::is_same_v<Objective, MinExpectedGuesses>);
+  const PatternTable& table = *search.table;
+  int num_guesses_left = search.max_num_guesses - num_guesses - 1;
+  if (DisjointBoards(boards, table.num_answers, guess) > num_guesses_left) {
+    return std::nullopt;
+  }
+  CountBoardPatterns(table, search.weights, guess, boards, buckets);
+  double lower_sum =
+      BoardsLowerSum<Objective>(buckets, board_weights, num_guesses_left);
+  if (lower_sum >= bound) {
+    return std::nullopt;
+  }
+  PlaceBoardWords(table, guess, boards, buckets);
+
+  double result = 0;
+  for (int b = 0; b < buckets.num_buckets; ++b) {
+    const int* new_words_left = &buckets.words[buckets.start[b]];
+    int new_num_words_left = buckets.size(b);
+    SetWeight new_weight = buckets.weight[b];
+    SetWeight board_weight = BoardBucketWeight(buckets, b, board_weights);
+    float expected;
+    if (buckets.keys[b] % kNumPatterns == kAllGreen) {
+      // Correct guess for this board.
+      expected = Objective::kGuessValue;
+    } else {
+      double lower = 0;
+      double new_bound;
+      if constexpr (Objective::kWorstCase) {
+        new_bound = bound - Objective::kGuessValue;
+      } else {
+        lower = board_weight.total *
+                (Objective::kGuessValue +
+                 Objective::LowerBound(new_num_words_left, new_weight,
+                                       num_guesses_left));
+        new_bound = (bound - (lower_sum - lower)) / board_weight.total -
+                    Objective::kGuessValue;
+      }
+      std::optional<float> next_result = RecurseWithGuessesLeft<Objective>(
+          search, num_guesses + 1, workspace, new_words_left,
+          new_num_words_left, new_weight, new_bound);
+      if (!next_result) {
+        return std::nullopt;
+      }
+      expected = Objective::kGuessValue + *next_result;
+      if constexpr (!Objective::kWorstCase) {
+        lower_sum += board_weight.total * expected - lower;
+      }
+    }
+    AddBucket<Objective>(result, board_weight, expected);
+  }
+  if (result >= bound) {
+    return std::nullopt;
+  }
+  return result;
+}
+
+// Finds the guess with the smallest value of EvaluateBoardsGuess for the given
+// boards, once num_guesses guesses have already been made. The guesses tried
+// are the words left on any board, and every guess that can't be the answer.
+// Guesses are ranked by their lower bound and tried in parallel on the pool,
+// best first, and ties are broken in favor of the first guess. The value of
+// the best guess is the sum of the expected number of guesses of every board,
+// each played on its own.
+//
+// Returns std::nullopt if the heuristic of EvaluateBoardsGuess finds no guess
+// that wins every board, e.g. if the boards certainly need more guesses than
+// are left. It may also find a guess when no play always wins all the boards.
+template <typename Objective>
+std::optional<BestGuess> FindBestBoardsGuess(
+    const SearchContext& search, int num_guesses, const Boards& boards,
+    ThreadPool& pool, std::vector<std::unique_ptr<Workspace>>& workspaces) {
+  const PatternTable& table = *search.table;
+  if (DisjointBoards(boards, table.num_answers, /*guess=*/-1) >
+      search.max_num_guesses - num_guesses) {
+    return std::nullopt;
+  }
+  std::vector<SetWeight> board_weights;
+  std::vector<bool> is_left(table.num_answers);
+  for (int i = 0; i < boards.num_boards(); ++i) {
+    board_weights.push_back(WeighWords(
+        search.weights, &boards.words[boards.start[i]], boards.size(i)));
+    for (int w = boards.start[i]; w < boards.start[i + 1]; ++w) {
+      is_left[boards.words[w]] = true;
+    }
+  }
+  BoardBuckets ranking_buckets(boards.num_boards(), boards.words.size());
+  std::vector<std::pair<double, int>> ranked;
+  for (int guess = 0; guess < table.num_guesses; ++guess) {
+    if (guess < table.num_answers && !is_left[guess]) {
+      continue;
+    }
+    CountBoardPatterns(table, search.weights, guess, boards, ranking_buckets);
+    double lower_sum = BoardsLowerSum<Objective>(
+        ranking_buckets, board_weights,
+        search.max_num_guesses - num_guesses - 1);
+    if (lower_sum < std::numeric_limits<double>::infinity()) {
+      ranked.emplace_back(lower_sum, guess);
+    }
+  }
+  std::sort(ranked.begin(), ranked.end());
+
+  std::vector<std::unique_ptr<BoardBuckets>> all_buckets;
+  for (int worker = 0; worker < pool.num_workers(); ++worker) {
+    all_buckets.emplace_back(
+        new BoardBuckets(boards.num_boards(), boards.words.size()));
+  }
+  // The best guess so far, packed by PackBest, or kNoBest.
+  std::atomic<uint64_t> best{kNoBest};
+  // Every worker runs the most recently added task of its own queue first, so
+  // the best ranked guesses are added last.
+  for (auto it = ranked.rbegin(); it != ranked.rend(); ++it) {
+    int guess = it->second;
+    pool.Submit([&, guess](int worker) {
+      uint64_t packed = best.load(std::memory_order_relaxed);
+      double bound = std::numeric_limits<double>::infinity();
+      if (packed != kNoBest) {
+        bound = UnpackBest(packed).expected + kBoundSlack;
+      }
+      std::optional<float> result = EvaluateBoardsGuess<Objective>(
+          search, num_guesses, *workspaces[worker], *all_buckets[worker], guess,
+          boards, board_weights, bound);
+      if (!result) {
+        return;
+      }
+      packed = PackBest(guess, *result);
+      uint64_t current = best.load(std::memory_order_relaxed);
+      while (packed < current &&
+             !best.compare_exchange_weak(current, packed,
+                                         std::memory_order_relaxed)) {
+      }
+    });
+  }
+  pool.Wait();
+  uint64_t packed = best.load(std::memory_order_relaxed);
+  if (packed == kNoBest) {
+    return std::nullopt;
+  }
+  return UnpackBest(packed);
+}
+
+// Same as above, for the expected number of guesses, which is the only
+// objective supported with several boards.
+std::optional<BestGuess> FindBestBoardsGuess(
+    const SearchContext& search, int num_guesses, const Boards& boards,
+    ThreadPool& pool, std::vector<std::unique_ptr<Workspace>>& workspaces) {
+  assert(search.objective == ObjectiveKind::kExpected);
+  return FindBestBoardsGuess<MinExpectedGuesses>(search, num_guesses, boards,
+                                                 pool, workspaces);
+}
+
+// Same as EvaluateGuess, for a guess tried in parallel with other guesses for
+// the same words, which share the best result so far in best, packed by
+// PackBest. Before recursing into every pattern, the bound is lowered to the
+// best result so far, so the guess is abandoned as soon as any other guess
+// proves it worse, instead of only once it's done.
+template <typename Objective>
+std::optional<float> EvaluateGuessWithSharedBound(
+    const SearchContext& search, int num_guesses, Workspace& workspace,
+    int guess, const int* words_left, int num_words_left, SetWeight weight,
+    const std::atomic<uint64_t>& best) {
+  // Returns the bound on the combined values of the patterns, given the
+  // latest best result.
+  auto load_bound_sum = [&]() {
+    uint64_t packed = best.load(std::memory_order_relaxed);
+    double bound = std::numeric_limits<double>::infinity();
+    if (packed != kNoBest) {
+      bound = UnpackBest(packed).expected + kBoundSlack;
+    }
+    return BoundSum<Objective>(bound, weight);
+  };
+  const PatternTable& table = *search.table;
+  PatternBuckets& buckets = workspace.all_buckets[num_guesses];
+  CountPatterns(table, search.weights, guess, words_left, num_words_left,
+                buckets);
+  if (buckets.num_buckets == 1 && buckets.patterns[0] != kAllGreen) {
+    return std::nullopt;
+  }
+  int num_guesses_left = search.max_num_guesses - num_guesses - 1;
+  double lower_sum = 0;
+  for (int b = 0; b < buckets.num_buckets; ++b) {
+    SetWeight bucket_weight = buckets.weight[b];
+    if (buckets.patterns[b] == kAllGreen) {
+      AddBucket<Objective>(lower_sum, bucket_weight, Objective::kGuessValue);
+    } else {
+      AddBucket<Objective>(lower_sum, bucket_weight,
+                           Objective::kGuessValue +
+                               Objective::LowerBound(buckets.size(b),
+                                                     bucket_weight,
+                                                     num_guesses_left));
+    }
+  }
+  if (lower_sum >= load_bound_sum()) {
+    return std::nullopt;
+  }
+  PlaceWords(table, guess, words_left, num_words_left, buckets);
+
+  float result = 0;
+  for (int b = 0; b < buckets.num_buckets; ++b) {
+    const int* new_words_left = &buckets.words[buckets.start[b]];
+    int new_num_words_left = buckets.size(b);
+    SetWeight new_weight = buckets.weight[b];
+    float expected;
+    if (new_words_left[0] == guess) {
+      expected = Objective::kGuessValue;
+    } else {
+      double bound_sum = load_bound_sum();
+      if (lower_sum >= bound_sum) {
+        // Another guess is already better.
+        return std::nullopt;
+      }
+      double lower = 0;
+      double new_bound;
+      if constexpr (Objective::kWorstCase) {
+        new_bound = bound_sum - Objective::kGuessValue;
+      } else {
+        lower = new_weight.total *
+                (Objective::kGuessValue +
+                 Objective::LowerBound(new_num_words_left, new_weight,
+                                       num_guesses_left));
+        new_bound = (bound_sum - (lower_sum - lower)) / new_weight.total -
+                    Objective::kGuessValue;
+      }
+      if (search.hard_table && new_num_words_left > 2) {
+        FilterAllowed(*search.hard_table, guess, buckets.patterns[b],
+                      workspace.all_allowed[num_guesses],
+                      workspace.all_allowed[num_guesses + 1]);
+      }
+      std::optional<float> next_result = RecurseWithGuessesLeft<Objective>(
+          search, num_guesses + 1, workspace, new_words_left,
+          new_num_words_left, new_weight, new_bound);
+      if (!next_result) {
+        return std::nullopt;
+      }
+      expected = Objective::kGuessValue + *next_result;
+      if constexpr (!Objective::kWorstCase) {
+        lower_sum += new_weight.total * expected - lower;
+      }
+    }
+    if constexpr (Objective::kWorstCase) {
+      result = std::max(result, expected);
+    } else {
+      result += new_weight.total * expected;
+    }
+  }
+  if constexpr (!Objective::kWorstCase) {
+    result /= weight.total;
+  }
+  return result;
+}
+
+// Same as FindBestGuess, with every guess tried as a separate task on the pool,
+// so a single position uses all the workers. The guesses are added best ranked
+// last, so every worker tries them best first, and they share the best result
+// so far, which cuts off the other guesses while they run. Ties are still
+// broken by the natural order of ForEachGuess.
+//
+// Must be called from a worker of the pool, which is given as worker, and
+// returns right away. done is called with the result once all the guesses are
+// tried, on whichever worker tries the last one. In hard mode, allowed are the
+// guesses allowed in the position.
+template <typename Objective>
+void FindBestGuessInParallel(
+    const SearchContext& search, int num_guesses, ThreadPool& pool, int worker,
+    std::vector<std::unique_ptr<Workspace>>& workspaces,
+    std::vector<int> words_left, const AllowedGuesses& allowed,
+    std::function<void(std::optional<BestGuess>)> done) {
+  struct Query {
+    std::vector<int> words_left;
+    SetWeight weight;
+    AllowedGuesses allowed;
+    // The guesses to try, by their order.
+    std::vector<int> guesses;
+    // The best result so far, packed by PackBest with the order of the guess
+    // instead of the guess, or kNoBest.
+    std::atomic<uint64_t> best{kNoBest};
+    std::atomic<int> num_left;
+    std::function<void(std::optional<BestGuess>)> done;
+  };
+  auto query = std::make_shared<Query>();
+  query->words_left = std::move(words_left);
+  query->weight = WeighWords(search.weights, query->words_left.data(),
+                             query->words_left.size());
+  query->allowed = allowed;
+  query->done = std::move(done);
+  Workspace& workspace = *workspaces[worker];
+  workspace.all_allowed[num_guesses] = allowed;
+  // The guesses in the order ForEachGuess would try them.
+  std::vector<std::pair<int, int>> ranked;
+  ForEachGuess<Objective>(search, num_guesses, workspace,
+                          query->words_left.data(), query->words_left.size(),
+                          query->weight, [&](int guess, int order) {
+                            ranked.emplace_back(guess, order);
+                            return std::numeric_limits<double>::infinity();
+                          });
+  if (ranked.empty()) {
+    query->done(std::nullopt);
+    return;
+  }
+  int num_words_left = query->words_left.size();
+  query->guesses.resize(num_words_left + search.table->num_guesses);
+  for (const auto& [guess, order] : ranked) {
+    query->guesses[order] = guess;
+  }
+  query->num_left = ranked.size();
+  for (auto it = ranked.rbegin(); it != ranked.rend(); ++it) {
+    int guess = it->first;
+    int order = it->second;
+    pool.Submit([&search, &workspaces, num_guesses, query, guess,
+                 order](int worker) {
+      Workspace& workspace = *workspaces[worker];
+      uint64_t packed = query->best.load(std::memory_order_relaxed);
+      bool skip = order >= query->words_left.size() && packed != kNoBest &&
+                  UnpackBest(packed).expected + kBoundSlack <=
+                      Objective::kOtherGuessBound;
+      if (!skip) {
+        if (search.hard_table) {
+          workspace.all_allowed[num_guesses] = query->allowed;
+        }
+        std::optional<float> result =
+            EvaluateGuessWithSharedBound<Objective>(
+                search, num_guesses, workspace, guess,
+                query->words_left.data(), query->words_left.size(),
+                query->weight, query->best);
+        if (result) {
+          packed = PackBest(order, *result);
+          uint64_t current = query->best.load(std::memory_order_relaxed);
+          while (packed < current &&
+                 !query->best.compare_exchange_weak(
+                     current, packed, std::memory_order_relaxed)) {
+          }
+        }
+      }
+      if (query->num_left.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+      }
+      packed = query->best.load(std::memory_order_relaxed);
+      if (packed == kNoBest) {
+        query->done(std::nullopt);
+        return;
+      }
+      BestGuess best = UnpackBest(packed);
+      query->done(BestGuess{query->guesses[best.word], best.expected});
+    });
+  }
+}
+
+// Same as above, for the objective of the search.
+void FindBestGuessInParallel(
+    const SearchContext& search, int num_guesses, ThreadPool& pool, int worker,
+    std::vector<std::unique_ptr<Workspace>>& workspaces,
+    std::vector<int> words_left, const AllowedGuesses& allowed,
+    std::function<void(std::optional<BestGuess>)> done) {
+  WithObjective(search, [&](auto objective) {
+    FindBestGuessInParallel<decltype(objective)>(
+        search, num_guesses, pool, worker, workspaces, std::move(words_left),
+        allowed, std::move(done));
+  });
+}
+
+// Plays guess once num_guesses guesses have already been made and the given
+// words are left, and then keeps playing the best guess of the search, for
+// every one of the words as the answer. Sets sequences[word] to played,
+// followed by all the guesses until the word is found.
+//
+// Every position is searched only once for all the words left in it, so
+// answers that share a prefix of their guesses share its searches.
+//
+// Returns false if some position can't be won within max_num_guesses guesses,
+// which never happens after optimal guesses.
+bool SimulateGuess(const SearchContext& search, int num_guesses,
+                   Workspace& workspace, const std::vector<int>& words_left,
+                   int guess, std::vector<int>& played,
+                   std::vector<std::vector<int>>& sequences) {
+  const PatternTable& table = *search.table;
+  PatternBuckets& buckets = workspace.all_buckets[num_guesses];
+  CountPatterns(table, search.weights, guess, words_left.data(),
+                words_left.size(), buckets);
+  PlaceWords(table, guess, words_left.data(), words_left.size(), buckets);
+  // Copies the buckets, since the storage is reused by the children.
+  std::vector<std::pair<int, std::vector<int>>> children;
+  for (int b = 0; b < buckets.num_buckets; ++b) {
+    children.emplace_back(
+        buckets.patterns[b],
+        std::vector<int>(&buckets.words[buckets.start[b]],
+                         &buckets.words[buckets.start[b + 1]]));
+  }
+  played.push_back(guess);
+  for (const auto& [pattern, child_words] : children) {
+    if (pattern == kAllGreen) {
+      sequences[guess] = played;
+      continue;
+    }
+    if (search.hard_table) {
+      FilterAllowed(*search.hard_table, guess, pattern,
+                    workspace.all_allowed[num_guesses],
+                    workspace.all_allowed[num_guesses + 1]);
+    }
+    std::optional<BestGuess> best =
+        FindBestGuess(search, num_guesses + 1, workspace, child_words.data(),
+                      child_words.size());
+    if (!best || !SimulateGuess(search, num_guesses + 1, workspace,
+                                child_words, best->word, played, sequences)) {
+      return false;
+    }
+  }
+  played.pop_back();
+  return true;
+}
+
+// Same as SimulateGuess, for the root guess played before any other guess, with
+// the patterns of the root guess searched in parallel on the pool. The
+// workspaces of the workers must have the allowed guesses of the position in
+// all_allowed[0] in hard mode.
+//
+// Returns false if some position can't be won, as SimulateGuess.
+bool SimulateAll(const SearchContext& search, ThreadPool& pool,
+                 std::vector<std::unique_ptr<Workspace>>& workspaces,
+                 const std::vector<int>& words_left, int root,
+                 std::vector<std::vector<int>>& sequences) {
+  const PatternTable& table = *search.table;
+  std::unique_ptr<PatternBuckets> buckets(new PatternBuckets);
+  std::vector<int> words(words_left.size());
+  buckets->words = words.data();
+  CountPatterns(table, search.weights, root, words_left.data(),
+                words_left.size(), *buckets);
+  PlaceWords(table, root, words_left.data(), words_left.size(), *buckets);
+  std::atomic<bool> won{true};
+  for (int b = 0; b < buckets->num_buckets; ++b) {
+    int pattern = buckets->patterns[b];
+    std::vector<int> child_words(&buckets->words[buckets->start[b]],
+                                 &buckets->words[buckets->start[b + 1]]);
+    if (pattern == kAllGreen) {
+      sequences[root] = {root};
+      continue;
+    }
+    pool.Submit([&, pattern, child_words](int worker) {
+      Workspace& workspace = *workspaces[worker];
+      if (search.hard_table) {
+        FilterAllowed(*search.hard_table, root, pattern,
+                      workspace.all_allowed[0], workspace.all_allowed[1]);
+      }
+      std::optional<BestGuess> best =
+          FindBestGuess(search, /*num_guesses=*/1, workspace,
+                        child_words.data(), child_words.size());
+      std::vector<int> played = {root};
+      if (!best || !SimulateGuess(search, /*num_guesses=*/1, workspace,
+                                  child_words, best->word, played, sequences)) {
+        won.store(false, std::memory_order_relaxed);
+      }
+    });
+  }
+  pool.Wait();
+  return won.load(std::memory_order_relaxed);
+}
+
+// Saves the guesses played for every answer by SimulateAll to the given file,
+// one answer per line followed by its guesses, and writes the histogram of the
+// number of guesses needed to out. num_guesses is the number of guesses already
+// made, which is included in the counts.
+void SaveSimulation(const std::string& filename,
+                    const std::vector<std::string>& guess_words,
+                    const std::vector<int>& words_left, int num_guesses,
+                    const std::vector<std::vector<int>>& sequences,
+                    std::ostream& out) {
+  std::ofstream fout(filename);
+  std::map<int, int> histogram;
+  int64_t total = 0;
+  for (int word : words_left) {
+    fout << guess_words[word];
+    for (int guess : sequences[word]) {
+      fout << " " << guess_words[guess];
+    }
+    fout << std::endl;
+    int needed = num_guesses + sequences[word].size();
+    ++histogram[needed];
+    total += needed;
+  }
+  out << "Guesses needed for all " << words_left.size() << " answers:"
+      << std::endl;
+  for (const auto& [needed, count] : histogram) {
+    out << needed << ": " << count << std::endl;
+  }
+  out << "Average: " << static_cast<double>(total) / words_left.size()
+      << std::endl;
+}
+
+// Runs the solver as a long-running server, so the words and the pattern table
+// are only loaded once, and the cache stays warm between queries.
+//
+// Every line read from in is a query with the guesses already made, in the same
+// format as on the command line, e.g. "plate __g_g shame y_g_g". An empty line
+// asks for the first guess. For every query, one line is written to out, in the
+// same order as the queries:
+//
+//   <word> <expected> = the best next guess and the expected number of guesses
+//                       you need to make to win, including that guess, or its
+//                       value for the objective of the search.
+//   lose              = it's not possible to always win.
+//   error: <message>  = the query is not valid.
+//
+// Queries are computed concurrently on the pool, and so are the guesses tried
+// for every query, see FindBestGuessInParallel. Identical queries that are in
+// flight at the same time are only computed once. If tree is not null,
+// queries that follow the tree are answered from it right away, without any
+// search.
+void Serve(const std::vector<std::string>& guess_words,
+           const std::vector<std::string>& words,
+           const SearchContext& search, const DecisionTree* tree,
+           ThreadPool& pool, std::istream& in, std::ostream& out) {
+  std::vector<std::unique_ptr<Workspace>> workspaces = CreateWorkspaces(
+      pool, search.max_num_guesses, words.size(), search.table->num_guesses);
+
+  // Responses in the order of the queries. An empty optional means there are
+  // no more queries.
+  std::mutex responses_mu;
+  std::condition_variable responses_cv;
+  std::deque<std::optional<std::shared_future<std::string>>> responses;
+  std::thread writer([&]() {
+    while (true) {
+      std::optional<std::shared_future<std::string>> response;
+      {
+        std::unique_lock<std::mutex> lock(responses_mu);
+        responses_cv.wait(lock, [&]() { return !responses.empty(); });
+        response = responses.front();
+        responses.pop_front();
+      }
+      if (!response) {
+        return;
+      }
+      out << response->get() << std::endl;
+    }
+  });
+
+  // Queries being computed, by the normalized query.
+  std::mutex in_flight_mu;
+  std::map<std::string, std::shared_future<std::string>> in_flight;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream sin(line);
+    std::vector<std::string> guesses;
+    for (std::string token; sin >> token;) {
+      guesses.push_back(token);
+    }
+    std::string query = JoinGuesses(guesses);
+
+    std::shared_future<std::string> response;
+    BestGuess next;
+    uint32_t node;
+    std::string error;
+    if (tree &&
+        LookupDecisionTree(*tree, guess_words, guesses, next, node, error)) {
+      std::promise<std::string> promise;
+      std::ostringstream sout;
+      sout << guess_words[next.word] << " " << next.expected;
+      promise.set_value(sout.str());
+      response = promise.get_future().share();
+    } else {
+      std::lock_guard<std::mutex> guard(in_flight_mu);
+      auto it = in_flight.find(query);
+      if (it != in_flight.end()) {
+        response = it->second;
+      } else {
+        auto promise = std::make_shared<std::promise<std::string>>();
+        response = promise->get_future().share();
+        in_flight.emplace(query, response);
+        // Sets the response of the query once it's computed.
+        auto respond = [&, query, promise](const std::string& response) {
+          std::lock_guard<std::mutex> guard(in_flight_mu);
+          promise->set_value(response);
+          in_flight.erase(query);
+        };
+        pool.Submit([&, guesses, respond](int worker) {
+          std::vector<int> words_left(words.size());
+          for (int word = 0; word < words.size(); ++word) {
+            words_left[word] = word;
+          }
+          std::string error;
+          AllowedGuesses allowed;
+          int num_guesses = guesses.size() / 2;
+          if (!ApplyGuesses(guess_words, *search.table, guesses, words_left,
+                            error) ||
+              (search.hard_table &&
+               !ApplyHardMode(guess_words, *search.table, *search.hard_table,
+                              guesses, allowed, error))) {
+            respond("error: " + error);
+          } else if (num_guesses >= search.max_num_guesses) {
+            respond("error: Too many guesses");
+          } else {
+            // The guesses are tried in parallel, so a single query uses all
+            // the workers.
+            FindBestGuessInParallel(
+                search, num_guesses, pool, worker, workspaces,
+                std::move(words_left), allowed,
+                [&guess_words, respond](std::optional<BestGuess> best) {
+                  std::ostringstream sout;
+                  if (best) {
+                    sout << guess_words[best->word] << " " << best->expected;
+                  } else {
+                    sout << "lose";
+                  }
+                  respond(sout.str());
+                });
+          }
+        });
+      }
+    }
+    {
+      std::lock_guard<std::mutex> guard(responses_mu);
+      responses.push_back(response);
+    }
+    responses_cv.notify_one();
+  }
+  {
+    std::lock_guard<std::mutex> guard(responses_mu);
+    responses.push_back(std::nullopt);
+  }
+  responses_cv.notify_one();
+  writer.join();
+  pool.Wait();
+}
+
+// Positions searched by the benchmarks, as the guesses already made. They
+// range from a few words left to a few hundred.
+static const char* const kBenchPositions[] = {
+    "plate __g_g", "plate _y___", "jazzy _____", "crane _____",
+};
+// First words that the benchmarks fully evaluate against all the words, down to
+// the end of every game. A search limited to 2 guesses would give up at the
+// first set of words it can't solve, so it wouldn't measure much.
+static const char* const kBenchFirstWords[] = {
+    "plate", "crane", "jazzy",
+};
+// Turns of a game that the benchmarks play from scratch, including applying
+// the guesses, like the solver does for a single query.
+static const char* const kBenchTurns[] = {
+    "plate __g_g",
+    "plate __g_g shame y_g_g",
+    "crane _y___ sloth __y__",
+};
+
+// Returns the peak resident set size of the process so far, in KiB.
+long PeakRssKb() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// Splits the given guesses already made into words.
+std::vector<std::string> SplitGuesses(const std::string& guesses) {
+  std::istringstream sin(guesses);
+  std::vector<std::string> split;
+  for (std::string token; sin >> token;) {
+    split.push_back(token);
+  }
+  return split;
+}
+
+// Runs fixed workloads that cover the expensive parts of the solver, and
+// writes how long each of them took to out as JSON. Every search runs on a
+// single thread with a fresh cache of cache_bytes bytes, so the results only
+// depend on the build and the machine. search has the settings of the
+// searches, except for the cache.
+void RunBenchmarks(const std::vector<std::string>& guess_words,
+                   const std::vector<std::string>& words,
+                   const SearchContext& search, size_t cache_bytes,
+                   int num_threads, std::ostream& out) {
+  const PatternTable& table = *search.table;
+  std::vector<int> all_words(words.size());
+  for (int word = 0; word < words.size(); ++word) {
+    all_words[word] = word;
+  }
+
+  out << "{\n  \"threads\": " << num_threads << ",\n  \"workloads\": [";
+  bool first = true;
+  // Runs the given workload, which is given the search settings and a
+  // workspace that counts its nodes, and writes its result. The nodes are only
+  // written for workloads that search.
+  auto run = [&](const std::string& name, bool searches,
+                 const std::function<void(const SearchContext&, Workspace&)>&
+                     workload) {
+    std::unique_ptr<TranspositionTable> cache;
+    if (cache_bytes > 0) {
+      cache.reset(new TranspositionTable(cache_bytes, words.size(),
+                                         search.max_num_guesses));
+    }
+    SearchContext context = search;
+    context.cache = cache.get();
+    Workspace workspace(search.max_num_guesses, words.size(),
+                        table.num_guesses);
+    auto start = std::chrono::steady_clock::now();
+    workload(context, workspace);
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    out << (first ? "\n" : ",\n") << "    {\"name\": \"" << name
+        << "\", \"seconds\": " << seconds;
+    if (searches) {
+      out << ", \"nodes\": " << workspace.num_nodes.load()
+          << ", \"nodes_per_second\": " << workspace.num_nodes.load() / seconds;
+    }
+    out << ", \"peak_rss_kb\": " << PeakRssKb() << "}";
+    out.flush();
+    first = false;
+  };
+
+  run("table", /*searches=*/false,
+      [&](const SearchContext& /*context*/, Workspace& /*workspace*/) {
+        ComputeWordPatternMatches(guess_words, words, num_threads);
+      });
+  for (const char* position : kBenchPositions) {
+    std::vector<std::string> guesses = SplitGuesses(position);
+    std::vector<int> words_left = all_words;
+    std::string error;
+    if (!ApplyGuesses(guess_words, table, guesses, words_left, error)) {
+      continue;
+    }
+    run(std::string("recurse ") + position, /*searches=*/true,
+        [&](const SearchContext& context, Workspace& workspace) {
+          WithObjective(context, [&](auto objective) {
+            return RecurseWithGuessesLeft<decltype(objective)>(
+                context, guesses.size() / 2, workspace, words_left.data(),
+                words_left.size(),
+                WeighWords(context.weights, words_left.data(),
+                           words_left.size()),
+                std::numeric_limits<double>::infinity());
+          });
+        });
+  }
+  for (const char* first_word : kBenchFirstWords) {
+    int guess = std::find(guess_words.begin(), guess_words.end(), first_word) -
+                guess_words.begin();
+    if (guess == guess_words.size()) {
+      continue;
+    }
+    run(std::string("evaluate_first_word ") + first_word, /*searches=*/true,
+        [&](const SearchContext& context, Workspace& workspace) {
+          WithObjective(context, [&](auto objective) {
+            return EvaluateGuess<decltype(objective), kAnyGuessesLeft>(
+                context, /*num_guesses=*/0, workspace, guess, all_words.data(),
+                all_words.size(),
+                WeighWords(context.weights, all_words.data(),
+                           all_words.size()),
+                std::numeric_limits<double>::infinity());
+          });
+        });
+  }
+  for (const char* turn : kBenchTurns) {
+    std::vector<std::string> guesses = SplitGuesses(turn);
+    run(std::string("turn ") + turn, /*searches=*/true,
+        [&](const SearchContext& context, Workspace& workspace) {
+          std::vector<int> words_left = all_words;
+          std::string error;
+          if (ApplyGuesses(guess_words, table, guesses, words_left, error)) {
+            FindBestGuess(context, guesses.size() / 2, workspace,
+                          words_left.data(), words_left.size());
+          }
+        });
+  }
+  out << "\n  ],\n  \"peak_rss_kb\": " << PeakRssKb() << "\n}" << std::endl;
+}
+
+// Returns the first line of the checkpoint file of a sweep with the given
+// settings. A checkpoint is only resumed if its first line is the same, since
+// the results of the first words depend on all of them.
+std::string CheckpointHeader(const std::vector<std::string>& guess_words,
+                             const std::vector<std::string>& guesses,
+                             const std::vector<float>& weights,
+                             bool hard_mode, ObjectiveKind objective,
+                             int max_guesses, bool best_only, int beam) {
+  std::ostringstream sout;
+  sout << "checkpoint " << std::hex << HashWords(guess_words) << std::dec;
+  if (!weights.empty()) {
+    sout << " weights=" << std::hex << HashWeights(weights) << std::dec;
+  }
+  if (hard_mode) {
+    sout << " hard_mode=1";
+  }
+  if (objective != ObjectiveKind::kExpected) {
+    sout << " objective=" << static_cast<int>(objective);
+  }
+  if (max_guesses != kDefaultMaxNumGuesses) {
+    sout << " max_guesses=" << max_guesses;
+  }
+  sout << " best_only=" << best_only << " beam=" << beam << " "
+       << JoinGuesses(guesses);
+  return sout.str();
+}
+
+// Loads the first words that are already done from the given checkpoint file.
+// After the header line, the file has one line for every first word done: the
+// word followed by its expected number of guesses, or "-" if it has none. A
+// line that was only partially written when the sweep was stopped is ignored.
+//
+// Returns false if the file doesn't exist or its header doesn't match.
+bool LoadCheckpoint(const std::string& filename, const std::string& header,
+                    const std::vector<std::string>& guess_words,
+                    std::vector<std::pair<int, std::optional<float>>>& done) {
+  std::ifstream fin(filename);
+  std::string line;
+  if (!std::getline(fin, line) || line != header) {
+    return false;
+  }
+  std::map<std::string, int> word_indices;
+  for (int word = 0; word < guess_words.size(); ++word) {
+    word_indices.emplace(guess_words[word], word);
+  }
+  // Every complete line ends with a newline, which getline only reports as
+  // missing for the last line.
+  while (std::getline(fin, line) && !fin.eof()) {
+    std::istringstream sin(line);
+    std::string word;
+    std::string result;
+    if (!(sin >> word >> result)) {
+      break;
+    }
+    auto it = word_indices.find(word);
+    if (it == word_indices.end()) {
+      break;
+    }
+    if (result == "-") {
+      done.emplace_back(it->second, std::nullopt);
+    } else {
+      done.emplace_back(it->second, std::strtof(result.c_str(), nullptr));
+    }
+  }
+  return true;
+}
+
+// Starts the checkpoint file of a sweep over with the given header and the
+// given first words done, and opens it in sweep.checkpoint to append to. The
+// file is written under a temporary name first and then renamed, so stopping
+// the sweep meanwhile never loses the first words done.
+//
+// Returns false if the file can't be written.
+bool OpenCheckpoint(
+    const std::string& filename, const std::string& header,
+    const std::vector<std::pair<int, std::optional<float>>>& done,
+    Sweep& sweep) {
+  std::string temp_filename = TempFilename(filename);
+  sweep.checkpoint.open(temp_filename);
+  sweep.checkpoint << header << std::endl;
+  for (const std::pair<int, std::optional<float>>& word : done) {
+    SaveCheckpoint(sweep, word.first, word.second);
+  }
+  sweep.checkpoint.close();
+  if (!sweep.checkpoint ||
+      std::rename(temp_filename.c_str(), filename.c_str()) != 0) {
+    std::remove(temp_filename.c_str());
+    return false;
+  }
+  sweep.checkpoint.open(filename, std::ios::app);
+  return sweep.checkpoint.good();
+}
+
+// A TCP connection that sends and receives text one line at a time.
+class Connection {
+ public:
+  explicit Connection(int fd) : fd_(fd) {
+    // Detects nodes that went away without closing the connection, within
+    // about a minute instead of the 2 hours of the kernel defaults.
+    int keep_alive = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_KEEPALIVE, &keep_alive, sizeof(keep_alive));
+    setsockopt(fd_, IPPROTO_TCP, TCP_KEEPIDLE, &kKeepAliveIdleSeconds,
+               sizeof(kKeepAliveIdleSeconds));
+    setsockopt(fd_, IPPROTO_TCP, TCP_KEEPINTVL, &kKeepAliveIntervalSeconds,
+               sizeof(kKeepAliveIntervalSeconds));
+    setsockopt(fd_, IPPROTO_TCP, TCP_KEEPCNT, &kKeepAliveProbes,
+               sizeof(kKeepAliveProbes));
+  }
+  ~Connection() { close(fd_); }
+
+  // Reads the next line, without the newline. Returns false once the
+  // connection is closed or broken.
+  bool ReadLine(std::string& line) {
+    while (true) {
+      size_t newline = buffer_.find('\n');
+      if (newline != std::string::npos) {
+        line = buffer_.substr(0, newline);
+        buffer_.erase(0, newline + 1);
+        return true;
+      }
+      char data[4096];
+      ssize_t size = recv(fd_, data, sizeof(data), 0);
+      if (size <= 0) {
+        return false;
+      }
+      buffer_.append(data, size);
+    }
+  }
+
+  // Sends the given line, adding the newline. Returns false if the connection
+  // is broken. A broken connection doesn't raise SIGPIPE.
+  bool WriteLine(const std::string& line) {
+    std::string data = line + "\n";
+    for (size_t sent = 0; sent < data.size();) {
+      ssize_t size =
+          send(fd_, &data[sent], data.size() - sent, MSG_NOSIGNAL);
+      if (size <= 0) {
+        return false;
+      }
+      sent += size;
+    }
+    return true;
+  }
+
+  // Makes any blocked and later reads and writes fail right away.
+  void Shutdown() { shutdown(fd_, SHUT_RDWR); }
+
+ private:
+  // A connection is lost once it has been idle for kKeepAliveIdleSeconds and
+  // then kKeepAliveProbes probes, kKeepAliveIntervalSeconds apart, got no
+  // answer.
+  static constexpr int kKeepAliveIdleSeconds = 30;
+  static constexpr int kKeepAliveIntervalSeconds = 10;
+  static constexpr int kKeepAliveProbes = 3;
+
+  int fd_;
+  std::string buffer_;
+};
+
+// Lines to send on a connection, which a thread of its own sends, so whoever
+// queues them never waits for the other end, even if it stopped reading.
+class Outbox {
+ public:
+  explicit Outbox(Connection& connection)
+      : connection_(connection), thread_([this]() { Run(); }) {}
+
+  // Stops sending, dropping the lines not sent yet.
+  ~Outbox() {
+    {
+      std::lock_guard<std::mutex> guard(mu_);
+      stop_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+  }
+
+  // Queues the given line, without the newline.
+  void Send(std::string line) {
+    {
+      std::lock_guard<std::mutex> guard(mu_);
+      lines_.push_back(std::move(line));
+    }
+    changed_.notify_all();
+  }
+
+  // Shuts the connection down once all the lines queued so far are sent.
+  void Close() {
+    {
+      std::lock_guard<std::mutex> guard(mu_);
+      close_ = true;
+    }
+    changed_.notify_all();
+  }
+
+ private:
+  void Run() {
+    std::unique_lock<std::mutex> lock(mu_);
+    while (true) {
+      changed_.wait(lock,
+                    [this]() { return stop_ || close_ || !lines_.empty(); });
+      if (stop_) {
+        return;
+      }
+      if (lines_.empty()) {
+        connection_.Shutdown();
+        return;
+      }
+      std::deque<std::string> lines;
+      lines.swap(lines_);
+      lock.unlock();
+      for (const std::string& line : lines) {
+        if (!connection_.WriteLine(line)) {
+          // Makes the reader of the connection see that it's lost.
+          connection_.Shutdown();
+          return;
+        }
+      }
+      lock.lock();
+    }
+  }
+
+  Connection& connection_;
+  std::mutex mu_;
+  std::condition_variable changed_;
+  std::deque<std::string> lines_;
+  bool close_ = false;
+  bool stop_ = false;
+  // Must be last, so everything else is initialized before it runs.
+  std::thread thread_;
+};
+
+// Connects to the given address, of the form host:port.
+//
+// Returns nullptr if the connection fails.
+std::unique_ptr<Connection> Connect(const std::string& address) {
+  size_t colon = address.rfind(':');
+  if (colon == std::string::npos) {
+    return nullptr;
+  }
+  std::string host = address.substr(0, colon);
+  std::string port = address.substr(colon + 1);
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addresses;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+    return nullptr;
+  }
+  int fd = -1;
+  for (addrinfo* a = addresses; a; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+      break;
+    }
+    if (fd >= 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (fd < 0) {
+    return nullptr;
+  }
+  return std::unique_ptr<Connection>(new Connection(fd));
+}
+
+// Returns a socket listening on the given port on all interfaces, or -1 if it
+// can't listen on it.
+int Listen(int port) {
+  int fd = socket(AF_INET6, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  // Accepts IPv4 connections as well.
+  int v6_only = 0;
+  setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6_only, sizeof(v6_only));
+  sockaddr_in6 address = {};
+  address.sin6_family = AF_INET6;
+  address.sin6_addr = in6addr_any;
+  address.sin6_port = htons(port);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// A sweep can be spread over many machines. A coordinator hands out the first
+// words to the workers that connect to it and saves their results, exactly as
+// if it had tried the first words itself. Each line of the protocol is a
+// command followed by its arguments:
+//
+//   worker: hello <header>    = the header of the checkpoint of the worker's
+//                               sweep, see CheckpointHeader, which must be the
+//                               same as the coordinator's.
+//   worker: more <n>          = asks for n more first words.
+//   worker: result <word> <r> = first word done, with its full precision
+//                               result, or "-" if it has none.
+//   coordinator: word <word>  = a first word to try.
+//   coordinator: bound <b>    = the best result found so far by any worker, if
+//                               the sweep only computes the best word.
+//   coordinator: done         = all the first words are done.
+//   coordinator: error <msg>  = the worker can't take part in the sweep.
+//
+// If a worker is lost, the first words it hasn't finished are handed out
+// again.
+struct CoordinatorState {
+  // A connected worker.
+  struct Node {
+    std::unique_ptr<Connection> connection;
+    // Sends the lines for the worker, so they are queued while mu is held and
+    // sent without it. Destroyed before the connection.
+    std::unique_ptr<Outbox> outbox;
+    // Number of first words asked for but not yet handed out.
+    int num_wanted = 0;
+    // First words handed out but not yet done.
+    std::set<int> assigned;
+  };
+
+  // Guards everything below. Lines for the workers are only queued on their
+  // outboxes while it's held, so a worker that stops reading never blocks the
+  // others.
+  std::mutex mu;
+  // First words not handed out to any worker.
+  std::deque<int> unassigned;
+  // Number of first words not yet done.
+  int num_left = 0;
+  std::set<Node*> nodes;
+  // The bound last sent to the workers.
+  float bound = std::numeric_limits<float>::infinity();
+};
+
+// Hands out the unassigned first words to the workers that want more. state.mu
+// must be held.
+void AssignFirstWords(const Sweep& sweep, CoordinatorState& state) {
+  for (CoordinatorState::Node* node : state.nodes) {
+    while (node->num_wanted > 0 && !state.unassigned.empty()) {
+      int first_word = state.unassigned.front();
+      state.unassigned.pop_front();
+      node->assigned.insert(first_word);
+      --node->num_wanted;
+      node->outbox->Send("word " + (*sweep.guess_words)[first_word]);
+    }
+  }
+}
+
+// Talks to the worker on the given connection until it's lost or all the first
+// words are done.
+void ServeWorker(Sweep& sweep, CoordinatorState& state,
+                 const std::map<std::string, int>& word_indices,
+                 const std::string& header,
+                 std::unique_ptr<Connection> connection) {
+  std::string line;
+  if (!connection->ReadLine(line) || line != "hello " + header) {
+    connection->WriteLine("error The worker has different settings");
+    return;
+  }
+  CoordinatorState::Node node;
+  node.connection = std::move(connection);
+  node.outbox.reset(new Outbox(*node.connection));
+  {
+    std::lock_guard<std::mutex> guard(state.mu);
+    if (state.num_left == 0) {
+      node.outbox->Send("done");
+      node.outbox->Close();
+    } else {
+      state.nodes.insert(&node);
+      if (sweep.best_bound) {
+        std::ostringstream sout;
+        sout << std::setprecision(std::numeric_limits<float>::max_digits10)
+             << "bound " << state.bound;
+        node.outbox->Send(sout.str());
+      }
+    }
+  }
+  while (node.connection->ReadLine(line)) {
+    std::istringstream sin(line);
+    std::string command;
+    sin >> command;
+    if (command == "more") {
+      int num_wanted = 0;
+      sin >> num_wanted;
+      std::lock_guard<std::mutex> guard(state.mu);
+      node.num_wanted += num_wanted;
+      AssignFirstWords(sweep, state);
+      continue;
+    }
+    std::string word;
+    std::string result;
+    auto it = word_indices.end();
+    if (command == "result" && sin >> word >> result) {
+      it = word_indices.find(word);
+    }
+    if (it == word_indices.end()) {
+      std::cerr << "Invalid message from a worker: " << line << std::endl;
+      break;
+    }
+    int first_word = it->second;
+    {
+      std::lock_guard<std::mutex> guard(state.mu);
+      if (node.assigned.erase(first_word) == 0) {
+        continue;
+      }
+    }
+    std::optional<float> expected;
+    if (result != "-") {
+      expected = std::strtof(result.c_str(), nullptr);
+    }
+    FinishFirstWord(sweep, first_word, expected);
+
+    std::lock_guard<std::mutex> guard(state.mu);
+    --state.num_left;
+    if (sweep.best_bound) {
+      float bound = sweep.best_bound->load(std::memory_order_relaxed);
+      if (bound < state.bound) {
+        state.bound = bound;
+        std::ostringstream sout;
+        sout << std::setprecision(std::numeric_limits<float>::max_digits10)
+             << "bound " << bound;
+        for (CoordinatorState::Node* other : state.nodes) {
+          other->outbox->Send(sout.str());
+        }
+      }
+    }
+    if (state.num_left == 0) {
+      for (CoordinatorState::Node* other : state.nodes) {
+        other->outbox->Send("done");
+        other->outbox->Close();
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(state.mu);
+  state.nodes.erase(&node);
+  if (!node.assigned.empty()) {
+    std::cerr << "Lost a worker, handing out its " << node.assigned.size()
+              << " first words again." << std::endl;
+    state.unassigned.insert(state.unassigned.begin(), node.assigned.begin(),
+                            node.assigned.end());
+    AssignFirstWords(sweep, state);
+  }
+}
+
+// Tries the given first words on the workers that connect to the given port,
+// instead of on this machine, and saves the results in sweep. Returns once all
+// of them are done.
+//
+// Returns false if it can't listen on the port.
+bool Coordinate(Sweep& sweep, const std::vector<int>& first_words, int port,
+                const std::string& header) {
+  int listen_fd = Listen(port);
+  if (listen_fd < 0) {
+    return false;
+  }
+  std::map<std::string, int> word_indices;
+  for (int word = 0; word < sweep.guess_words->size(); ++word) {
+    word_indices.emplace((*sweep.guess_words)[word], word);
+  }
+
+  CoordinatorState state;
+  state.unassigned.assign(first_words.begin(), first_words.end());
+  state.num_left = first_words.size();
+  if (sweep.best_bound) {
+    state.bound = sweep.best_bound->load(std::memory_order_relaxed);
+  }
+  std::cout << "Waiting for workers on port " << port << "." << std::endl;
+  std::vector<std::thread> threads;
+  while (true) {
+    {
+      std::lock_guard<std::mutex> guard(state.mu);
+      if (state.num_left == 0) {
+        break;
+      }
+    }
+    // Wakes up every second to check whether all first words are done.
+    pollfd poll_fd = {listen_fd, POLLIN, 0};
+    if (poll(&poll_fd, 1, 1000) <= 0) {
+      continue;
+    }
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+    std::unique_ptr<Connection> connection(new Connection(fd));
+    threads.emplace_back([&, connection = std::move(connection)]() mutable {
+      ServeWorker(sweep, state, word_indices, header, std::move(connection));
+    });
+  }
+  close(listen_fd);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return true;
+}
+
+// Tries the first words handed out by the coordinator at the given address, of
+// the form host:port, on the pool, and sends back the results.
+//
+// Returns false and sets error if the sweep can't be completed, in which case
+// tasks may still be running on the pool.
+bool Work(Sweep& sweep, ThreadPool& pool, bool split_first_words,
+          const std::string& address, const std::string& header,
+          std::string& error) {
+  // Tasks still running after an error keep the connection alive.
+  std::shared_ptr<Connection> connection = Connect(address);
+  if (!connection) {
+    error = "Failed to connect to the coordinator: " + address;
+    return false;
+  }
+  std::map<std::string, int> word_indices;
+  for (int word = 0; word < sweep.guess_words->size(); ++word) {
+    word_indices.emplace((*sweep.guess_words)[word], word);
+  }
+  // Results are only sent by the ResultWriter, so writes never interleave.
+  sweep.on_finish = [&sweep, connection](int first_word,
+                                         std::optional<float> result) {
+    std::ostringstream sout;
+    sout << std::setprecision(std::numeric_limits<float>::max_digits10)
+         << "result " << (*sweep.guess_words)[first_word] << " ";
+    if (result) {
+      sout << *result;
+    } else {
+      sout << "-";
+    }
+    connection->WriteLine(sout.str());
+    connection->WriteLine("more 1");
+  };
+  // Keeps enough first words queued that no thread of the pool is idle.
+  connection->WriteLine("hello " + header);
+  connection->WriteLine("more " + std::to_string(2 * pool.num_workers()));
+  ResultWriter writer(sweep);
+
+  bool done = false;
+  std::string line;
+  while (!done && connection->ReadLine(line)) {
+    std::istringstream sin(line);
+    std::string command;
+    sin >> command;
+    if (command == "word") {
+      std::string word;
+      sin >> word;
+      auto it = word_indices.find(word);
+      if (it == word_indices.end()) {
+        error = "Unknown word from the coordinator: " + word;
+        break;
+      }
+      int first_word = it->second;
+      if (split_first_words) {
+        pool.Submit([&sweep, &pool, first_word](int worker) {
+          SplitAndTryFirstWord(sweep, pool, worker, first_word);
+        });
+      } else {
+        pool.Submit([&sweep, first_word](int worker) {
+          TryFirstWord(sweep, worker, first_word);
+        });
+      }
+    } else if (command == "bound") {
+      float bound;
+      if (sin >> bound) {
+        LowerBestBound(sweep, bound);
+      }
+    } else if (command == "done") {
+      done = true;
+    } else if (command == "error") {
+      error = "The coordinator refused: " + line.substr(command.size() + 1);
+      break;
+    }
+  }
+  if (!done) {
+    if (error.empty()) {
+      error = "Lost the coordinator";
+    }
+    // The tasks still queued or running can't send their results anymore.
+    connection->Shutdown();
+    return false;
+  }
+  pool.Wait();
+  return true;
+}
+
+// Saves the SearchStats of all the workspaces of the given sweep to the given
+// file, along with how long every first word took, slowest first.
+void SaveStats(const std::string& filename, const Sweep& sweep) {
+  SearchStats stats(sweep.search.max_num_guesses);
+  for (const std::unique_ptr<Workspace>& workspace : sweep.workspaces) {
+    stats.Add(workspace->stats);
+  }
+  std::ofstream fout(filename);
+  fout << "depth nodes cache_hits guesses cutoffs aborts" << std::endl;
+  for (int d = 0; d < stats.nodes.size(); ++d) {
+    fout << d << " " << stats.nodes[d] << " " << stats.cache_hits[d] << " "
+         << stats.guesses[d] << " " << stats.cutoffs[d] << " "
+         << stats.aborts[d] << std::endl;
+  }
+  fout << std::endl << "depth bucket_size_histogram" << std::endl;
+  for (int d = 0; d < stats.nodes.size(); ++d) {
+    fout << d;
+    for (int k = 0; k < kNumSizeBins; ++k) {
+      fout << " " << (1 << k) << ":" << stats.bucket_sizes[d][k];
+    }
+    fout << std::endl;
+  }
+  std::vector<std::pair<double, int>> times;
+  for (int word = 0; word < sweep.first_word_seconds.size(); ++word) {
+    if (sweep.first_word_seconds[word] > 0) {
+      times.emplace_back(sweep.first_word_seconds[word], word);
+    }
+  }
+  std::sort(times.rbegin(), times.rend());
+  fout << std::endl << "seconds first_word" << std::endl;
+  for (const std::pair<double, int>& time : times) {
+    fout << time.first << " " << (*sweep.guess_words)[time.second]
+         << std::endl;
+  }
+}
+
+// Command line flags, given as --name=value anywhere among the guesses.
+struct Flags {
+  // Memory budget of the transposition table in MiB. 0 disables the cache.
+  int cache_mb = 256;
+  // Whether to only compute the best word, in which case first words that
+  // can't beat the best word found so far are skipped.
+  bool best_only = false;
+  // File with the possible answers, one per line. Every word must have
+  // kWordLength letters, so other word lengths need their own build.
+  std::string answers_file = "wordle-answers-alphabetical.txt";
+  // File with the words that are allowed as guesses, one per line, in addition
+  // to the answers. If given, every allowed guess is tried, including answers
+  // that are no longer possible, instead of only the words left.
+  std::string guesses_file;
+  // File to load the pattern table from. If the file doesn't exist or is for
+  // different words, the table is computed and saved to it. Empty means the
+  // table is always computed.
+  std::string table_file;
+  // File to save the decision tree of the optimal strategy to, once the best
+  // word is computed.
+  std::string export_tree;
+  // File to load the decision tree from, to look up the next word without any
+  // search.
+  std::string tree;
+  // Whether to run as a server, reading queries from stdin. See Serve.
+  bool serve = false;
+  // Whether to run the benchmarks and write their results as JSON to stdout.
+  // See RunBenchmarks.
+  bool bench = false;
+  // Number of worker threads. 0 means one per hardware thread.
+  int threads = 0;
+  // Whether every pattern of every first word is a separate task, instead of
+  // every first word. This balances the load better when there are only a few
+  // first words to try.
+  bool split_first_words = false;
+  // If positive, only this many of the most promising guesses are tried for
+  // every set of words after the first guess. This is much faster, but the
+  // result may not be optimal, and positions that can be won may be reported
+  // as lost.
+  int beam = 0;
+  // File to record the first words done in, so a stopped sweep can be resumed.
+  // The cache is saved next to it, in the same file name with ".cache" added.
+  std::string checkpoint;
+  // Whether to resume the sweep from the checkpoint file, skipping the first
+  // words that are already done.
+  bool resume = false;
+  // Interval in seconds at which the progress of a sweep is reported to
+  // stderr. 0 disables it.
+  int progress = 60;
+  // If positive, the port to listen on for workers, which try the first words
+  // instead of this machine. See Coordinate.
+  int coordinator = 0;
+  // Address of the coordinator to try first words for, of the form host:port.
+  // See Work.
+  std::string worker;
+  // File with how likely every answer is, see ReadWeights. If given, the
+  // expected number of guesses is weighted by it, instead of every answer being
+  // equally likely.
+  std::string weights_file;
+  // Whether to play in strict hard mode, where every guess must still be
+  // possible as the answer given all the patterns seen so far. This only
+  // changes the search with --guesses_file, since otherwise only words left are
+  // ever guessed.
+  bool hard_mode = false;
+  // What to optimize: "expected" for the expected number of guesses,
+  // "worst_case" for the number of guesses in the worst case, or "win_rate" for
+  // the probability of winning within max_guesses guesses.
+  ObjectiveKind objective = ObjectiveKind::kExpected;
+  // Maximum number of guesses, including the guesses already made.
+  int max_guesses = kDefaultMaxNumGuesses;
+  // File to save the guesses played for every answer to, once the best word
+  // is computed. See SimulateAll.
+  std::string simulate_all;
+  // Number of best first words, with their results, written to stdout once the
+  // sweep is done.
+  int top = 10;
+  // Number of boards played at once, as in Quordle (4) or Octordle (8). With
+  // more than one, every guess is followed by a pattern for every board. See
+  // FindBestBoardsGuess.
+  int boards = 1;
+};
+
+// Returns the value of the flag arg as an integer. Exits with an error if value
+// isn't one.
+int ParseInt(const std::string& arg, const std::string& value) {
+  size_t end = 0;
+  int result = 0;
+  try {
+    result = std::stoi(value, &end);
+  } catch (const std::logic_error&) {
+    end = 0;
+  }
+  if (end == 0 || end != value.size()) {
+    std::cerr << "Invalid number: " << arg << std::endl;
+    std::exit(1);
+  }
+  return result;
+}
+
+// Parses the flags out of the command line arguments and returns the
+// remaining arguments.
+std::vector<std::string> ParseFlags(int args, char* argv[], Flags& flags) {
+  std::vector<std::string> positional;
+  for (int i = 1; i < args; ++i) {
+    std::string arg = argv[i];
+    if (arg.rfind("--", 0) != 0) {
+      positional.push_back(arg);
+      continue;
+    }
+    size_t equals = arg.find('=');
+    std::string name = arg.substr(2, equals - 2);
+    std::string value =
+        equals == std::string::npos ? "" : arg.substr(equals + 1);
+    if (name == "cache_mb") {
+      flags.cache_mb = ParseInt(arg, value);
+    } else if (name == "best_only") {
+      flags.best_only = value.empty() || value == "true";
+    } else if (name == "answers_file") {
+      flags.answers_file = value;
+    } else if (name == "guesses_file") {
+      flags.guesses_file = value;
+    } else if (name == "table_file") {
+      flags.table_file = value;
+    } else if (name == "export_tree") {
+      flags.export_tree = value;
+    } else if (name == "tree") {
+      flags.tree = value;
+    } else if (name == "serve") {
+      flags.serve = value.empty() || value == "true";
+    } else if (name == "bench") {
+      flags.bench = value.empty() || value == "true";
+    } else if (name == "threads") {
+      flags.threads = ParseInt(arg, value);
+    } else if (name == "split_first_words") {
+      flags.split_first_words = value.empty() || value == "true";
+    } else if (name == "beam") {
+      flags.beam = ParseInt(arg, value);
+    } else if (name == "checkpoint") {
+      flags.checkpoint = value;
+    } else if (name == "resume") {
+      flags.resume = value.empty() || value == "true";
+    } else if (name == "progress") {
+      flags.progress = ParseInt(arg, value);
+    } else if (name == "coordinator") {
+      flags.coordinator = ParseInt(arg, value);
+    } else if (name == "worker") {
+      flags.worker = value;
+    } else if (name == "weights_file") {
+      flags.weights_file = value;
+    } else if (name == "strict_hard_mode") {
+      flags.hard_mode = value.empty() || value == "true";
+    } else if (name == "objective") {
+      if (value == "expected") {
+        flags.objective = ObjectiveKind::kExpected;
+      } else if (value == "worst_case") {
+        flags.objective = ObjectiveKind::kWorstCase;
+      } else if (value == "win_rate") {
+        flags.objective = ObjectiveKind::kWinRate;
+      } else {
+        std::cerr << "Unknown objective: " << value << std::endl;
+        std::exit(1);
+      }
+    } else if (name == "max_guesses") {
+      flags.max_guesses = ParseInt(arg, value);
+    } else if (name == "simulate_all") {
+      flags.simulate_all = value;
+    } else if (name == "top") {
+      flags.top = ParseInt(arg, value);
+    } else if (name == "boards") {
+      flags.boards = ParseInt(arg, value);
+    } else {
+      std::cerr << "Unknown flag: " << arg << std::endl;
+      std::exit(1);
+    }
+  }
+  return positional;
+}
+
+int main(int args, char* argv[]) {
+  Flags flags;
+  std::vector<std::string> guesses = ParseFlags(args, argv, flags);
+  if (flags.max_guesses <= 0) {
+    std::cerr << "--max_guesses must be positive" << std::endl;
+    return 1;
+  }
+  // Decision trees store the expected number of guesses of every node, and
+  // simulations play the same guesses as them.
+  if (flags.objective != ObjectiveKind::kExpected &&
+      (!flags.tree.empty() || !flags.export_tree.empty() ||
+       !flags.simulate_all.empty())) {
+    std::cerr << "--tree, --export_tree and --simulate_all only support "
+              << "--objective=expected" << std::endl;
+    return 1;
+  }
+  if (flags.boards <= 0) {
+    std::cerr << "--boards must be positive" << std::endl;
+    return 1;
+  }
+  if (flags.boards > 1 && (flags.serve || flags.bench || flags.hard_mode ||
+                           !flags.tree.empty() || !flags.export_tree.empty())) {
+    std::cerr << "--boards only works with a single query, not with --serve, "
+              << "--bench, --strict_hard_mode, --tree or --export_tree"
+              << std::endl;
+    return 1;
+  }
+  if (flags.boards > 1 && flags.objective != ObjectiveKind::kExpected) {
+    std::cerr << "--boards only supports --objective=expected" << std::endl;
+    return 1;
+  }
+  int max_num_guesses = flags.max_guesses;
+
+  int num_threads = flags.threads;
+  if (num_threads <= 0) {
+    num_threads = std::max<int>(1, std::thread::hardware_concurrency());
+  }
+
+  std::vector<std::string> words = ReadWords(flags.answers_file);
+  if (words.empty()) {
+    std::cerr << "Failed to read the answers: " << flags.answers_file
+              << std::endl;
+    return 1;
+  }
+  for (const std::string& word : words) {
+    if (word.size() != kWordLength) {
+      std::cerr << "Invalid answer: " << word << ". Words must have "
+                << kWordLength << " letters, see WORDLE_WORD_LENGTH"
+                << std::endl;
+      return 1;
+    }
+  }
+  // All the words that can be guessed, which start with the answers.
+  std::vector<std::string> guess_words = words;
+  if (!flags.guesses_file.empty()) {
+    std::vector<std::string> allowed = ReadWords(flags.guesses_file);
+    if (allowed.empty()) {
+      std::cerr << "Failed to read the guesses: " << flags.guesses_file
+                << std::endl;
+      return 1;
+    }
+    std::sort(allowed.begin(), allowed.end());
+    allowed.erase(std::unique(allowed.begin(), allowed.end()), allowed.end());
+    std::vector<std::string> sorted_words = words;
+    std::sort(sorted_words.begin(), sorted_words.end());
+    for (const std::string& word : allowed) {
+      if (word.size() != kWordLength) {
+        std::cerr << "Invalid guess: " << word << std::endl;
+        return 1;
+      }
+      if (!std::binary_search(sorted_words.begin(), sorted_words.end(),
+                              word)) {
+        guess_words.push_back(word);
+      }
+    }
+  }
+
+  // Weight of every answer, or empty if they are all equally likely.
+  std::vector<float> weights;
+  if (!flags.weights_file.empty()) {
+    std::string error;
+    if (!ReadWeights(flags.weights_file, words, weights, error)) {
+      std::cerr << error << std::endl;
+      return 1;
+    }
+  }
+  const float* weights_data = weights.empty() ? nullptr : weights.data();
+
+  PatternTable table;
+  std::optional<PatternTable> loaded_table;
+  if (!flags.table_file.empty()) {
+    loaded_table = LoadPatternTable(flags.table_file, guess_words, words);
+  }
+  if (loaded_table) {
+    table = *loaded_table;
+  } else {
+    table = ComputeWordPatternMatches(guess_words, words, num_threads);
+    if (!flags.table_file.empty()) {
+      SavePatternTable(flags.table_file, guess_words, words, table);
+    }
+  }
+
+  // In hard mode, the patterns of every guess against every guess that can't be
+  // the answer.
+  PatternTable hard_table;
+  if (flags.hard_mode) {
+    std::vector<std::string> other_guesses(guess_words.begin() + words.size(),
+                                           guess_words.end());
+    hard_table =
+        ComputeWordPatternMatches(guess_words, other_guesses, num_threads);
+  }
+  const PatternTable* hard_table_data = flags.hard_mode ? &hard_table : nullptr;
+
+  if (flags.bench) {
+    SearchContext search;
+    search.max_num_guesses = max_num_guesses;
+    search.table = &table;
+    search.beam_width = flags.beam;
+    search.weights = weights_data;
+    search.objective = flags.objective;
+    RunBenchmarks(guess_words, words, search,
+                  static_cast<size_t>(flags.cache_mb) << 20, num_threads,
+                  std::cout);
+    return 0;
+  }
+
+  std::optional<DecisionTree> tree;
+  if (!flags.tree.empty()) {
+    tree = LoadDecisionTree(flags.tree, guess_words, words);
+    if (!tree) {
+      std::cerr << "Failed to load the decision tree: " << flags.tree
+                << std::endl;
+      return 1;
+    }
+  }
+
+  if (flags.serve) {
+    std::unique_ptr<TranspositionTable> cache;
+    if (flags.cache_mb > 0) {
+      cache.reset(new TranspositionTable(
+          static_cast<size_t>(flags.cache_mb) << 20, words.size(),
+          max_num_guesses));
+    }
+    ThreadPool pool(num_threads);
+    SearchContext search;
+    search.max_num_guesses = max_num_guesses;
+    search.table = &table;
+    search.cache = cache.get();
+    search.beam_width = flags.beam;
+    search.weights = weights_data;
+    search.hard_table = hard_table_data;
+    search.objective = flags.objective;
+    Serve(guess_words, words, search, tree ? &*tree : nullptr, pool, std::cin,
+          std::cout);
+    return 0;
+  }
+
+  if (flags.boards > 1) {
+    Boards boards;
+    std::string error;
+    if (!ApplyBoardGuesses(guess_words, table, flags.boards, guesses, boards,
+                           error)) {
+      std::cerr << error << std::endl;
+      return 1;
+    }
+    int num_guesses = guesses.size() / (flags.boards + 1);
+    if (boards.words.empty()) {
+      std::cerr << "All boards are solved" << std::endl;
+      return 1;
+    }
+    if (num_guesses >= max_num_guesses) {
+      std::cerr << "Too many guesses" << std::endl;
+      return 1;
+    }
+    // All the boards share one cache, since their sets of words left recur.
+    std::unique_ptr<TranspositionTable> cache;
+    if (flags.cache_mb > 0) {
+      cache.reset(new TranspositionTable(
+          static_cast<size_t>(flags.cache_mb) << 20, words.size(),
+          max_num_guesses));
+    }
+    SearchContext search;
+    search.max_num_guesses = max_num_guesses;
+    search.table = &table;
+    search.cache = cache.get();
+    search.beam_width = flags.beam;
+    search.weights = weights_data;
+    search.objective = flags.objective;
+    ThreadPool pool(num_threads);
+    std::vector<std::unique_ptr<Workspace>> workspaces = CreateWorkspaces(
+        pool, max_num_guesses, words.size(), table.num_guesses);
+    std::optional<BestGuess> best =
+        FindBestBoardsGuess(search, num_guesses, boards, pool, workspaces);
+    std::cout << "Computation is done. ";
+    if (!best) {
+      std::cout << "You can't win!" << std::endl;
+    } else {
+      std::cout << "Play the word: " << guess_words[best->word] << std::endl;
+      std::cout << "Sum of the expected number of guesses of every board, "
+                << "played on its own: " << best->expected << std::endl;
+    }
+    return 0;
+  }
+
+  // Applies any guesses already made by prunning the list of words. Words are
+  // kept as indices into the full list, so the pattern table is only ever
+  // computed once.
+  std::vector<int> words_left(words.size());
+  for (int word = 0; word < words.size(); ++word) {
+    words_left[word] = word;
+  }
+  std::string error;
+  if (!ApplyGuesses(guess_words, table, guesses, words_left, error)) {
+    std::cerr << error << std::endl;
+    return 1;
+  }
+
+  if (tree) {
+    BestGuess next;
+    uint32_t node;
+    if (LookupDecisionTree(*tree, guess_words, guesses, next, node, error)) {
+      std::cout << "Play the word: " << guess_words[next.word] << std::endl;
+      if (!flags.simulate_all.empty()) {
+        std::vector<std::vector<int>> sequences(table.num_answers);
+        if (!SimulateDecisionTree(*tree, table, guess_words.size(), node,
+                                  words_left, sequences, error)) {
+          std::cerr << error << std::endl;
+          return 1;
+        }
+        SaveSimulation(flags.simulate_all, guess_words, words_left,
+                       guesses.size() / 2, sequences, std::cout);
+        std::cout << "Saved the guesses for every answer in: "
+                  << flags.simulate_all << std::endl;
+      }
+      return 0;
+    }
+    std::cerr << error << ". Searching instead." << std::endl;
+  }
+
+  AllowedGuesses allowed;
+  if (flags.hard_mode && !ApplyHardMode(guess_words, table, hard_table,
+                                        guesses, allowed, error)) {
+    std::cerr << error << std::endl;
+    return 1;
+  }
+  max_num_guesses -= guesses.size() / 2;
+  if (max_num_guesses <= 0) {
+    std::cerr << "Too many guesses" << std::endl;
+    return 1;
+  }
+
+  std::unique_ptr<TranspositionTable> cache;
+  if (flags.cache_mb > 0) {
+    cache.reset(new TranspositionTable(
+        static_cast<size_t>(flags.cache_mb) << 20, words.size(),
+        max_num_guesses));
+  }
+
+  // First words already done by an earlier run of the same sweep.
+  std::vector<std::pair<int, std::optional<float>>> done;
+  std::string checkpoint_header =
+      CheckpointHeader(guess_words, guesses, weights, flags.hard_mode,
+                       flags.objective, flags.max_guesses, flags.best_only,
+                       flags.beam);
+  std::string cache_file;
+  if (flags.resume && flags.checkpoint.empty()) {
+    std::cerr << "--resume needs --checkpoint" << std::endl;
+    return 1;
+  }
+  if (!flags.worker.empty() && !flags.checkpoint.empty()) {
+    std::cerr << "--checkpoint is only for the coordinator" << std::endl;
+    return 1;
+  }
+  if (!flags.checkpoint.empty()) {
+    if (cache && flags.coordinator == 0) {
+      cache_file = flags.checkpoint + ".cache";
+    }
+    if (!flags.resume) {
+      // The cache of an earlier sweep may have been computed with different
+      // settings.
+      std::remove(cache_file.c_str());
+    } else if (!LoadCheckpoint(flags.checkpoint, checkpoint_header,
+                               guess_words, done)) {
+      std::cerr << "Failed to load the checkpoint for these settings: "
+                << flags.checkpoint << std::endl;
+      return 1;
+    } else {
+      std::cout << "Resuming with " << done.size() << " first words done."
+                << std::endl;
+      if (cache && cache->Load(cache_file, guess_words, words)) {
+        std::cout << "Loaded the cache from: " << cache_file << std::endl;
+      }
+    }
+  }
+
+  Sweep sweep;
+  sweep.search.max_num_guesses = max_num_guesses;
+  sweep.search.table = &table;
+  sweep.search.cache = cache.get();
+  sweep.search.beam_width = flags.beam;
+  sweep.search.weights = weights_data;
+  sweep.search.hard_table = hard_table_data;
+  sweep.search.objective = flags.objective;
+  sweep.guess_words = &guess_words;
+  std::atomic<float> best_bound(std::numeric_limits<float>::infinity());
+  sweep.best_bound = flags.best_only ? &best_bound : nullptr;
+  sweep.words_left = words_left;
+  sweep.words_left_weight =
+      WeighWords(weights_data, words_left.data(), words_left.size());
+  sweep.allowed = allowed;
+  sweep.first_word_seconds.resize(table.num_guesses);
+  ThreadPool pool(num_threads);
+  sweep.workspaces = CreateWorkspaces(pool, max_num_guesses, words_left.size(),
+                                      table.num_guesses, allowed);
+
+  if (!flags.worker.empty()) {
+    std::string error;
+    if (!Work(sweep, pool, flags.split_first_words, flags.worker,
+              checkpoint_header, error)) {
+      std::cerr << error << std::endl;
+      // Doesn't wait for the tasks still running on the pool, whose results
+      // are lost anyway.
+      std::exit(1);
+    }
+    std::cout << "All first words are done." << std::endl;
+    return 0;
+  }
+
+  std::stringstream sout;
+  sout << "result" << (guesses.size() / 2 + 1) << ".csv";
+  sweep.fout.open(sout.str());
+  sweep.fout << "word,expected\n";
+  sweep.num_top = flags.top;
+  std::cout << "Saving results in: " << sout.str() << std::endl;
+  std::vector<bool> is_done(table.num_guesses);
+  for (const std::pair<int, std::optional<float>>& word : done) {
+    is_done[word.first] = true;
+    if (word.second) {
+      SaveResult(sweep, word.first, *word.second);
+      SaveBest(sweep, word.first, *word.second);
+    }
+  }
+  sweep.fout.flush();
+  if (!flags.checkpoint.empty()) {
+    if (!OpenCheckpoint(flags.checkpoint, checkpoint_header, done, sweep)) {
+      std::cerr << "Failed to save the checkpoint: " << flags.checkpoint
+                << std::endl;
+      return 1;
+    }
+    sweep.cache_file = cache_file;
+    sweep.answers = &words;
+    sweep.cache_saved_time = std::chrono::steady_clock::now();
+  }
+  // The first words not done by an earlier run.
+  std::vector<int> first_words;
+  WithObjective(sweep.search, [&](auto objective) {
+    ForEachGuessInOrder<decltype(objective)>(
+        table, flags.hard_mode ? &allowed : nullptr, words_left.data(),
+        words_left.size(), [&](int first_word, int /*order*/) {
+          if (!is_done[first_word]) {
+            first_words.push_back(first_word);
+          }
+          return std::numeric_limits<double>::infinity();
+        });
+  });
+  std::unique_ptr<ResultWriter> writer(new ResultWriter(sweep));
+  std::unique_ptr<ProgressReporter> progress;
+  if (flags.progress > 0) {
+    progress.reset(new ProgressReporter(sweep, first_words.size(),
+                                        std::chrono::seconds(flags.progress)));
+  }
+  if (flags.coordinator > 0) {
+    if (!Coordinate(sweep, first_words, flags.coordinator,
+                    checkpoint_header)) {
+      std::cerr << "Failed to listen on port " << flags.coordinator
+                << std::endl;
+      return 1;
+    }
+  } else {
+    for (int first_word : first_words) {
+      if (flags.split_first_words) {
+        pool.Submit([&sweep, &pool, first_word](int worker) {
+          SplitAndTryFirstWord(sweep, pool, worker, first_word);
+        });
+      } else {
+        pool.Submit([&sweep, first_word](int worker) {
+          TryFirstWord(sweep, worker, first_word);
+        });
+      }
+    }
+    pool.Wait();
+  }
+  progress.reset();
+  writer.reset();
+  int64_t num_endgames = 0;
+  for (const std::unique_ptr<Workspace>& workspace : sweep.workspaces) {
+    num_endgames += workspace->num_endgames;
+  }
+  std::cerr << "Solved " << num_endgames
+            << " small sets of words in closed form." << std::endl;
+  if (kCollectStats && flags.coordinator == 0) {
+    std::stringstream stats_filename;
+    stats_filename << "stats" << (guesses.size() / 2 + 1) << ".txt";
+    SaveStats(stats_filename.str(), sweep);
+    std::cout << "Saved the search stats in: " << stats_filename.str()
+              << std::endl;
+  }
+  std::optional<BestGuess> best = LoadBest(sweep);
+  std::cout << "Computation is done. ";
+  if (!best) {
+    std::cout << "You can't win!" << std::endl;
+  } else {
+    std::cout << "Play the word: " << guess_words[best->word] << std::endl;
+    if (!flags.export_tree.empty()) {
+      std::string error;
+      if (SaveDecisionTree(flags.export_tree, guess_words, words, guesses,
+                           sweep.search, words_left, allowed, *best, error)) {
+        std::cout << "Saved the decision tree in: " << flags.export_tree
+                  << std::endl;
+      } else {
+        std::cerr << error << std::endl;
+      }
+    }
+    if (!flags.simulate_all.empty()) {
+      std::vector<std::vector<int>> sequences(table.num_answers);
+      if (SimulateAll(sweep.search, pool, sweep.workspaces, words_left,
+                      best->word, sequences)) {
+        SaveSimulation(flags.simulate_all, guess_words, words_left,
+                       guesses.size() / 2, sequences, std::cout);
+        std::cout << "Saved the guesses for every answer in: "
+                  << flags.simulate_all << std::endl;
+      } else {
+        std::cerr << "Some answers can't be won with the simulated guesses"
+                  << std::endl;
+      }
+    }
+  }
+  sweep.fout.close();
+
+  if (!sweep.results.empty()) {
+    std::cout << "Best " << sweep.results.size() << " first words:"
+              << std::endl;
+    WriteResults(sweep, std::cout);
+  }
 }